@@ -26,8 +26,12 @@
 
 #include "LSculpt_functions.h"
 #include "LSculpt_obj.h"      // Wavefront OBJ loading
+#include "LSculpt_glb.h"      // glTF binary loading
+#include "LSculpt_input.h"    // buffered and gzip compressed input
+#include "LSculpt_soa.h"      // structure of arrays mesh kernels
 #include <string.h>
 #include <limits.h>
+#include <QFile>
 
 //
 // ===== Global variables =====
@@ -38,16 +42,49 @@
 // by scaling and translating the space partitioning cubes
 vector<Triangle>       inputmesh;
 
+// Point cloud input: the vertices of a file without faces,
+// rotated like the mesh, and their normals
+vector<CloudPoint>     inputpoints;
+
+// Ray tests of each triangle of the input mesh for rays along
+// each axis: all the triangles in the order of inputmesh for x,
+// then for y, then for z
+vector<RayRecord>      meshrays;
+
+// The same for the watertight ray test, on a fixed point grid with
+// its origin at the offset origin and meshfixscale steps per unit
+vector<FixedRayRecord> meshfixrays;
+SmReal                 meshfixscale;
+
+// Bounding volume hierarchy of the input mesh, in depth first
+// order, and the faces of its leaves as indices into inputmesh
+vector<BVHNode>        meshbvh;
+vector<unsigned int>   meshbvhfaces;
+
+// Triangles of the space partitioning cubes as indices into
+// inputmesh, the triangles of each cube side by side in the
+// order the cubes were added, see SpCube::tfirst
+vector<unsigned int>   cubefaces;
+
 // Pairing of each space partitioning cube with its location
-// in space.  The map allows easy lookup of a cube based
+// in space.  The hash table allows easy lookup of a cube based
 // on its location in space.
-map<SpCubeKey, SpCube> cubelist;
+SpCubeTable cubelist;
 
 // Queue of optimization energies
 multiset<SpCubeEnergy> cubeenergy;
 
-// Globals for PLY file reading
-vector<SmVector3> vtxs; // temporary global variable for storing vertices
+// Indexed form of the input mesh after welding: the shared
+// vertices, and three indices into them for each triangle
+vector<SmVector3>    meshvtxs;
+vector<unsigned int> meshfaces;
+
+// Extra meshes merged into the scene, with their placement
+vector<MeshPart> meshparts;
+
+// Set when the mesh was read from a mesh cache, which already
+// holds the normal vectors and bounding box of each triangle
+bool meshprepared = false;
 
 //
 // ===== Command line options =====
@@ -70,6 +107,7 @@ int main_wrapper(char *infile, char *outfile, void (*progress_cb)(const char *))
 {
 	bool noerr;
 	SmVector3 mn, mx, sz;
+	unsigned long long hash = 0;
 
 	if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << "TIME\t: PROGRESS" << endl;
 	if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: reading input file: " << infile << endl;
@@ -77,23 +115,46 @@ int main_wrapper(char *infile, char *outfile, void (*progress_cb)(const char *))
 
 	// Reset global collections - necessary now that main can be called multiple times per execution
 	inputmesh.clear();
+	inputpoints.clear();
+	meshrays.clear();
+	meshfixrays.clear();
+	meshbvh.clear();
+	meshbvhfaces.clear();
 	cubelist.clear();
+	cubefaces.clear();
 	cubeenergy.clear();
-  vtxs.clear();
+	meshvtxs.clear();
+	meshfaces.clear();
+	meshprepared = false;
+
+	// fuse the up axis, rotations and stretch into one transform
+	double up[3][4];
+	up_transform(args, up);
+	set_transform(args, up);
+
+	if(args.OPTS_CACHE && !meshparts.empty()) {
+		// the cache only covers a single input file
+		if(args.OPTS_MESSAGE) cerr << "WARNING: The mesh cache is not used for scenes with several meshes." << endl;
+		args.OPTS_CACHE = false;
+	}
 
-	switch(args.OPTS_FORMAT) {
-		case FORMAT_STL:
-			noerr = load_triangles_stl(infile);
-			break;
-        case FORMAT_OBJ:
-            noerr = load_triangles_obj(infile);
-            break;
-		case FORMAT_PLY:
-		default:
-			noerr = load_triangles_ply(infile);
-			break;
+	if(args.OPTS_CACHE) {
+		hash = mesh_cache_hash(infile);
+		meshprepared = load_mesh_cache(infile, hash);
+		if(meshprepared && args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: reading mesh cache: " << infile << MESHCACHE_EXT << endl;
+	}
+
+	if(meshprepared)
+		noerr = true;
+	else if(meshparts.empty())
+		noerr = load_mesh(infile, inputmesh, inputpoints, args);
+	else
+		noerr = load_scene(infile);
+	if(args.OPTS_MESSAGE==MESSAGE_ALL) {
+		cout << now() << "\t: mesh loaded, " << inputmesh.size() << " triangles";
+		if(!inputpoints.empty()) cout << " and " << inputpoints.size() << " points";
+		cout << endl;
 	}
-	if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: mesh loaded, " << inputmesh.size() << " triangles" << endl;
 	if (progress_cb) progress_cb("Calculating Mesh Bounds");
 
 	if(noerr) {
@@ -101,6 +162,37 @@ int main_wrapper(char *infile, char *outfile, void (*progress_cb)(const char *))
 		noerr = mesh_bounds(mn,mx);
 	}
 
+	if(noerr && !inputpoints.empty()) {
+		if (progress_cb) progress_cb("Estimating Point Normals");
+		estimate_point_normals();
+	}
+
+	// the cache only holds triangles, so point clouds are not cached
+	if(noerr && args.OPTS_CACHE && !meshprepared && inputpoints.empty()) {
+		if(save_mesh_cache(infile, hash)) {
+			if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: mesh cache saved: " << infile << MESHCACHE_EXT << endl;
+		} else {
+			if(args.OPTS_MESSAGE) cerr << "WARNING: Could not write mesh cache " << infile << MESHCACHE_EXT << endl;
+		}
+	}
+
+	// welding and decimation depend on the scale, so they run after
+	// the cache is written, on the mesh in the units of the file
+	if(noerr && !inputmesh.empty()) {
+		if(args.OPTS_WELD > 0.0) {
+			if (progress_cb) progress_cb("Welding Vertices");
+			weld_mesh();
+		}
+		if(args.OPTS_DECIMATE > 0.0) {
+			if (progress_cb) progress_cb("Decimating Mesh");
+			decimate_mesh();
+		}
+		if(inputmesh.empty() && inputpoints.empty()) {
+			if(args.OPTS_MESSAGE) cerr << "ERROR: No triangles are left after welding and decimation." << endl;
+			noerr = false;
+		}
+	}
+
 	if(noerr) {
 		sz = mx - mn;
 		int tmp = cout.precision();
@@ -112,12 +204,21 @@ int main_wrapper(char *infile, char *outfile, void (*progress_cb)(const char *))
 		cout.precision(tmp);
 		if (progress_cb) progress_cb("Partitioning Space");
 		partition_space();
-		if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: mesh partitioned into " << cubelist.size() << " cubes" << endl;
+		if(args.OPTS_MESSAGE==MESSAGE_ALL) {
+			cout << now() << "\t: mesh partitioned into " << cubelist.size() << " cubes";
+			if(cubelist.isdense()) cout << ", in a dense array of " << cubelist.volume();
+			cout << endl;
+		}
     if(args.OPTS_MAXITER >= 0 && args.OPTS_PLATES) {
 			if (progress_cb) progress_cb("Computing Normals");
 			compute_cube_normals();
 			if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: computed initial cube orientations" << endl;
 			if (progress_cb) progress_cb("Initializing Voxels");
+			compute_ray_records();
+			if(args.OPTS_BVH) {
+				build_bvh();
+				if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: bounding volume hierarchy built, " << meshbvh.size() << " nodes" << endl;
+			}
 			init_voxels();
 			if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: surfaces found in " << cubelist.size() << " cubes" << endl;
 		}
@@ -175,6 +276,8 @@ void load_options(int argc, char*argv[], char* in, char* out)
 						args.OPTS_FORMAT = FORMAT_STL;
                     else if (strcmp(arg,"OBJ")==0)
                         args.OPTS_FORMAT = FORMAT_OBJ;
+					else if (strcmp(arg,"GLB")==0)
+						args.OPTS_FORMAT = FORMAT_GLB;
 					else {
             strcpy(message, "ERROR: Unknown input file format: ");
             strcat(message, arg);
@@ -225,9 +328,20 @@ void load_options(int argc, char*argv[], char* in, char* out)
 					break;
 				case 'r':
 					args.OPTS_ROT = atof(argv[++i]);
-					args.OPTS_ROT_SIN = sin(args.OPTS_ROT*PI/180.0);
-					args.OPTS_ROT_COS = cos(args.OPTS_ROT*PI/180.0);
 					break;				
+				case 'x':
+					args.OPTS_AXIS[0] = atof(argv[++i]);
+					args.OPTS_AXIS[1] = atof(argv[++i]);
+					args.OPTS_AXIS[2] = atof(argv[++i]);
+					args.OPTS_ANGLE = atof(argv[++i]);
+					break;
+				case 'g':
+					args.OPTS_STRETCH[0] = atof(argv[++i]);
+					args.OPTS_STRETCH[1] = atof(argv[++i]);
+					args.OPTS_STRETCH[2] = atof(argv[++i]);
+					if (args.OPTS_STRETCH[0] == 0.0 || args.OPTS_STRETCH[1] == 0.0 || args.OPTS_STRETCH[2] == 0.0)
+						strcpy(message, "ERROR: Stretch factors must not be zero");
+					break;
 				case 's':
 					args.OPTS_SCALE /= atof(argv[++i]);
 					break;
@@ -262,6 +376,39 @@ void load_options(int argc, char*argv[], char* in, char* out)
 				case 'e':
 					args.OPTS_NOFILL = true;
 					break;
+				case 'W':
+					args.OPTS_WATERTIGHT = true;
+					break;
+				case 'B':
+					args.OPTS_BVH = true;
+					break;
+				case 'X':
+					args.OPTS_EXACT = true;
+					break;
+				case 'D':
+					if (atoi(argv[++i]) < 0)
+						strcpy(message, "ERROR: The dense cube limit must not be negative");
+					else
+						args.OPTS_DENSE = atoi(argv[i]);
+					break;
+				case 'm':
+					args.OPTS_CACHE = true;
+					break;
+				case 'l':
+					args.OPTS_WELD = atof(argv[++i]);
+					break;
+				case 't':
+					args.OPTS_DECIMATE = atof(argv[++i]);
+					break;
+				case 'j':
+					meshparts.push_back(MeshPart());
+					meshparts.back().file = argv[++i];
+					meshparts.back().offset[0] = atof(argv[++i]);
+					meshparts.back().offset[1] = atof(argv[++i]);
+					meshparts.back().offset[2] = atof(argv[++i]);
+					meshparts.back().rot = atof(argv[++i]);
+					meshparts.back().scale = atof(argv[++i]);
+					break;
 				default:
           strcpy(message, "ERROR: Unknown option: ");
           strcat(message, argv[i]);
@@ -293,6 +440,10 @@ void load_options(int argc, char*argv[], char* in, char* out)
 		if(args.OPTS_MESSAGE) cerr << "ERROR: Scale factor must be positive" << endl;
 		exit(1);
 	}
+	if(args.OPTS_WELD < 0.0 || args.OPTS_DECIMATE < 0.0) {
+		if(args.OPTS_MESSAGE) cerr << "ERROR: Welding and decimation sizes must not be negative" << endl;
+		exit(1);
+	}
 
 	setOutFile(args, in, out);
 	setFileFormat(&args, in);
@@ -308,8 +459,8 @@ void setOutFile(ArgumentSet localArgs, char *in, char *out)
 {
 	if(strcmp(out,"")==0)
 	{
-		if (!localArgs.OPTS_FORMAT)
-      strncpy(out,in,strrchr(in,'.')-in);
+		if (!localArgs.OPTS_FORMAT && meshextension(in))
+      strncpy(out,in,meshextension(in)-in);
 		else
       strcpy(out,in);
 
@@ -326,7 +477,11 @@ void setFileFormat(ArgumentSet *localArgs, char *in)
 
 	// if no input format specified, get it from the file extension
 	if(!localArgs->OPTS_FORMAT) {
-		strcpy(arg,strrchr(in,'.') + 1);
+		if(meshextension(in)) {
+			strncpy(arg,meshextension(in) + 1,sizeof(arg) - 1);
+			// drop the .gz of a compressed file
+			if(strchr(arg,'.')) *strchr(arg,'.') = '\0';
+		}
 		strupper(arg);
 		if (strcmp(arg,"PLY")==0)
 			localArgs->OPTS_FORMAT = FORMAT_PLY;
@@ -334,6 +489,8 @@ void setFileFormat(ArgumentSet *localArgs, char *in)
 			localArgs->OPTS_FORMAT = FORMAT_STL;
         else if (strcmp(arg,"OBJ")==0)
             localArgs->OPTS_FORMAT = FORMAT_OBJ;
+		else if (strcmp(arg,"GLB")==0)
+			localArgs->OPTS_FORMAT = FORMAT_GLB;
 		else {
 			localArgs->OPTS_FORMAT = FORMAT_PLY;
 			if(localArgs->OPTS_MESSAGE) cerr << "WARNING: Could not determine file format, assuming PLY." << endl;
@@ -341,6 +498,20 @@ void setFileFormat(ArgumentSet *localArgs, char *in)
 	}
 }
 
+char *meshextension(char *in)
+{
+	char *ext = strrchr(in,'.');
+
+	// for compressed files, use the extension before .gz
+	if(ext && ext > in && (strcmp(ext,".gz")==0 || strcmp(ext,".GZ")==0)) {
+		*ext = '\0';
+		char *inner = strrchr(in,'.');
+		*ext = '.';
+		if(inner) ext = inner;
+	}
+	return ext;
+}
+
 void strupper(char *str)
 {
 	while(*str) {
@@ -354,25 +525,46 @@ void usage()
     cout
     << "Usage: LSculpt [OPTIONS] inputfile [outputfile]"                               << endl
     << "inputfile     is a mesh of triangles in a supported format."				   << endl
+    << "              Files ending in .gz are decompressed while reading."             << endl
     << "outputfile    is the desired filename for the LDraw file.  If no filename is"  << endl
     << "              provided, the inputfile will receive an .ldr or .mpd extension." << endl
     << "OPTIONS may appear anywhere in the command line.  OPTIONS are:"                << endl
 	<< endl
     << " -i  format   force input format for mesh.  Default is from file extension."   << endl
-    << "              format = [ply, stl]"                                             << endl
+    << "              format = [ply, stl, obj, glb]"                                   << endl
     << " -u  unit     units for mesh, offset, or fit."                                 << endl
     << "              unit = [mm, cm, m, in, ft, stud, ldu (default)]"                 << endl
     << " -o  x y z    offset the origin to this location."                             << endl
     << " -c           re-center mesh at the origin."                                   << endl
 	<< " -d  up       up axis: up = [y (default), z]."                                 << endl
 	<< " -r  angle    rotate mesh about the 'up' axis by angle degrees."               << endl
+	<< " -x  x y z angle"                                                              << endl
+	<< "              then rotate mesh by angle degrees about the axis x y z."         << endl
+	<< " -g  x y z    then stretch mesh by x, y and z along each axis."                << endl
     << " -f  length   fit the mesh so the longest side is 'length' units."             << endl
     << " -s  factor   scale factor for mesh"                                           << endl
+	<< " -j  file x y z angle scale"                                                   << endl
+	<< "              add another mesh to the scene, scaled by 'scale', rotated"       << endl
+	<< "              about the 'up' axis by 'angle' degrees and moved to x y z."      << endl
+	<< "              May be repeated.  All files are loaded at the same time"         << endl
+	<< " -m           cache the loaded mesh in inputfile.lsmesh and reuse it on"       << endl
+	<< "              later runs with the same input file and transform, at any"       << endl
+	<< "              scale"                                                           << endl
+	<< " -l  dist     weld vertices closer than 'dist' voxel heights, e.g. 0.01,"      << endl
+	<< "              and remove duplicate triangles [0: off]"                         << endl
+	<< " -t  size     simplify the mesh by merging vertices within cells 'size'"       << endl
+	<< "              voxel heights wide, e.g. 0.5 for very detailed scans"            << endl
 	<< endl
 	<< " -b  level    use a base of studs up pieces for the bottom 'level' layers"     << endl
 	<< " -n           use only studs up pieces for the first attempt"                  << endl
 	<< " -e           create an empty shell (use with disconnected or overlapping"     << endl
 	<< "              surfaces that otherwise result in lots of artifacts"             << endl
+	<< " -W           watertight: snap the mesh to a fine grid for exact ray tests,"   << endl
+	<< "              so rays through shared edges and vertices hit only once"         << endl
+	<< " -B           find ray hits in a hierarchy of bounding boxes over the whole"   << endl
+	<< "              mesh instead of cube by cube, for meshes with large faces"       << endl
+	<< " -X           add large faces only to the cubes they cross instead of every"   << endl
+	<< "              cube of their bounding box.  Faster, but may leave holes"        << endl
 	<< " -a  part     choose which part to use in LDraw file. Choose from:"            << endl
 	<< "              0:  1 x 1 plate (default)"                                       << endl
 	<< "              1:  1 x 1 tile"                                                  << endl
@@ -401,60 +593,204 @@ void usage()
     << " -w           suppress all warning messages"                                   << endl;
 }
 
-bool load_triangles_obj(char *fname)
+bool load_mesh(char *fname, vector<Triangle> &mesh, vector<CloudPoint> &points, ArgumentSet &a)
 {
-  std::ifstream ifstream;
+	size_t first = mesh.size(), firstpoint = points.size();
+	bool noerr;
 
-  ifstream.open(fname);
-  if (!ifstream.is_open()) {
+	switch(a.OPTS_FORMAT) {
+		case FORMAT_STL:
+			noerr = load_triangles_stl(fname, mesh);
+			break;
+		case FORMAT_OBJ:
+			noerr = load_triangles_obj(fname, mesh, a);
+			break;
+		case FORMAT_GLB:
+			noerr = load_triangles_glb(fname, mesh, a);
+			break;
+		case FORMAT_PLY:
+		default:
+			noerr = load_triangles_ply(fname, mesh, points, a);
+			break;
+	}
+
+	// the loaders keep the coordinates of the file
+	transform_mesh(mesh, first, points, firstpoint, a);
+	return noerr;
+}
+
+void MeshLoader::run()
+{
+	ok = load_mesh(&file[0], mesh, points, args);
+}
+
+bool load_scene(char *infile)
+{
+	vector<MeshLoader *> loaders;
+	ArgumentSet partargs;
+	double up[3][4], rot[3][4], place[3][4];
+	unsigned int i, j, k;
+	size_t n, m;
+	bool noerr = true;
+
+	// the main input file, in place
+	loaders.push_back(new MeshLoader(infile, args));
+
+	// each extra part is scaled, rotated about the up axis and moved
+	// into place before the transform of the scene
+	up_transform(args, up);
+	for(i = 0; i < meshparts.size(); i++) {
+		const MeshPart &part = meshparts[i];
+		partargs = args;
+		partargs.OPTS_FORMAT = 0;
+		setFileFormat(&partargs, &meshparts[i].file[0]);
+		rotate_transform(SmVector3(0.0, 1.0, 0.0), part.rot, rot);
+		multiply_transform(rot, up, place);
+		for(j = 0; j < 3; j++) {
+			for(k = 0; k < 3; k++)
+				place[j][k] *= part.scale;
+			place[j][3] = up[j][0]*part.offset[0] + up[j][1]*part.offset[1] + up[j][2]*part.offset[2];
+		}
+		set_transform(partargs, place);
+		loaders.push_back(new MeshLoader(meshparts[i].file.c_str(), partargs));
+	}
+
+	// load all files at once
+	for(i = 0; i < loaders.size(); i++)
+		loaders[i]->start();
+	for(i = 0, n = 0, m = 0; i < loaders.size(); i++) {
+		loaders[i]->wait();
+		n += loaders[i]->mesh.size();
+		m += loaders[i]->points.size();
+	}
+
+	// merge them in command line order
+	inputmesh.reserve(n);
+	inputpoints.reserve(m);
+	for(i = 0; i < loaders.size(); i++) {
+		if(!loaders[i]->ok) {
+			if(args.OPTS_MESSAGE) cerr << "ERROR: Could not load " << (i ? meshparts[i-1].file.c_str() : infile) << endl;
+			noerr = false;
+		}
+		inputmesh.insert(inputmesh.end(), loaders[i]->mesh.begin(), loaders[i]->mesh.end());
+		inputpoints.insert(inputpoints.end(), loaders[i]->points.begin(), loaders[i]->points.end());
+		if(args.OPTS_MESSAGE==MESSAGE_ALL) {
+			cout << now() << "\t: " << (i ? meshparts[i-1].file.c_str() : infile) << ": " << loaders[i]->mesh.size() << " triangles";
+			if(!loaders[i]->points.empty()) cout << " and " << loaders[i]->points.size() << " points";
+			cout << endl;
+		}
+		delete loaders[i];
+	}
+
+	return noerr;
+}
+
+bool load_triangles_obj(char *fname, vector<Triangle> &mesh, ArgumentSet &a)
+{
+  MeshInput input;
+
+  if (!input.open(fname)) {
     std::cerr << "OBJ: " << fname << ": " << "no such file or directory" << "\n";
     return false;
   }
+  std::istream istream(&input);
 
   class obj_loader load_obj;
-  return load_obj.convert(ifstream, inputmesh, args);
+  bool noerr = load_obj.convert(istream, mesh, a);
+  if (input.failed()) {
+    std::cerr << "ERROR: Corrupt compressed file or read error in " << fname << ".\n";
+    return false;
+  }
+  return noerr;
+}
+
+bool load_triangles_glb(char *fname, vector<Triangle> &mesh, ArgumentSet &a)
+{
+  MeshInput input;
+
+  if (!input.open(fname)) {
+    std::cerr << "GLB: " << fname << ": " << "no such file or directory" << "\n";
+    return false;
+  }
+
+  class glb_loader load_glb;
+  bool noerr = load_glb.convert(input, mesh, a);
+  if (input.failed()) {
+    std::cerr << "ERROR: Corrupt compressed file or read error in " << fname << ".\n";
+    return false;
+  }
+  return noerr;
 }
 
 //
 // PLY input code adapted from source code available at
 // http://www.cs.princeton.edu/~diego/professional/rply
 //
-bool load_triangles_ply(char *fname)
+bool load_triangles_ply(char *fname, vector<Triangle> &mesh, vector<CloudPoint> &points, ArgumentSet &a)
 {
 	long nvertices, ntriangles;
+	size_t i;
+	MeshInput input;
+	PlyState state(&mesh, &a);
 
 	// Open PLY file
-    p_ply ply = ply_open(fname, NULL, NULL, NULL);
-
-	// Error check file
-	if (!ply) {
+	if (!input.open(fname)) {
 		cerr << "ERROR: Invalid or unreadable PLY file.";
 		return false;
 	}
+    p_ply ply = ply_open_from_source(MeshInput::plysource, &input, NULL, 0, NULL);
 
-	if (!ply_read_header(ply)) {
-		cerr << "ERROR: Invalid or unreadable PLY file.";
+	// Error check file
+	if (!ply || !ply_read_header(ply)) {
+		if (input.failed())
+			cerr << "ERROR: Corrupt compressed file or read error in " << fname << ".\n";
+		else
+			cerr << "ERROR: Invalid or unreadable PLY file.";
+		if (ply) ply_close(ply);
 		return false;
 	}
 
 	// call vertex input callback function for each coordinate
-	nvertices = ply_set_read_cb(ply, "vertex", "x", myply_vertex_cb, NULL, 0);
-	ply_set_read_cb(ply, "vertex", "y", myply_vertex_cb, NULL, 1);
-	ply_set_read_cb(ply, "vertex", "z", myply_vertex_cb, NULL, 2);
+	nvertices = ply_set_read_cb(ply, "vertex", "x", myply_vertex_cb, &state, 0);
+	ply_set_read_cb(ply, "vertex", "y", myply_vertex_cb, &state, 1);
+	ply_set_read_cb(ply, "vertex", "z", myply_vertex_cb, &state, 2);
 
 	// call face input callback function for each list of faces
-	ntriangles = ply_set_read_cb(ply, "face", "vertex_indices", myply_face_cb, NULL, 0);
+	ntriangles = ply_set_read_cb(ply, "face", "vertex_indices", myply_face_cb, &state, 0);
 
 	// call face input callback function for each list triangle strip
-  ntriangles += ply_set_read_cb(ply, "tristrips", "vertex_indices", myply_face_cb, NULL, 1);
+  ntriangles += ply_set_read_cb(ply, "tristrips", "vertex_indices", myply_face_cb, &state, 1);
 
-  if (nvertices <= 0 || ntriangles <= 0)
+  if (nvertices <= 0)
     cerr << "WARNING: No polygons found in Mesh file.\n";
 
+	// without faces the vertices are a point cloud, so also read their normals
+	if (ntriangles <= 0) {
+		ply_set_read_cb(ply, "vertex", "nx", myply_vertex_cb, &state, 3);
+		ply_set_read_cb(ply, "vertex", "ny", myply_vertex_cb, &state, 4);
+		ply_set_read_cb(ply, "vertex", "nz", myply_vertex_cb, &state, 5);
+	}
+
 	// read the actual file in
-	if (!ply_read(ply))
+	if (!ply_read(ply) && !input.failed())
 		cerr << "WARNING: Problems reading Mesh file - 3D model may be incorrect.\n";
 	ply_close(ply);
+	if (input.failed()) {
+		cerr << "ERROR: Corrupt compressed file or read error in " << fname << ".\n";
+		return false;
+	}
+
+	if (ntriangles <= 0) {
+		points.reserve(points.size() + state.vtxs.size());
+		for (i = 0; i < state.vtxs.size(); i++) {
+			points.push_back(CloudPoint());
+			points.back().p = state.vtxs[i];
+			if (i < state.nrms.size()) {
+				points.back().n = state.nrms[i];
+				normalize(points.back().n);
+			}
+		}
+	}
 
 	return true; //success
 }
@@ -462,36 +798,34 @@ bool load_triangles_ply(char *fname)
 // PLY file: read vertex callback function
 int myply_vertex_cb(p_ply_argument argument) {
     long coord;
-    ply_get_argument_user_data(argument, NULL, &coord);
+    void *pdata;
+    ply_get_argument_user_data(argument, &pdata, &coord);
+
+	// coordinates 3-5 are the components of the normal
+	vector<SmVector3> &vtxs = (coord < 3) ? ((PlyState *) pdata)->vtxs : ((PlyState *) pdata)->nrms;
+	coord %= 3;
 
 	// new x coordinate => new vertex
 	if (coord == 0)
 		vtxs.push_back(SmVector3());
 
 	// store vertex coordinate
-	switch (args.OPTS_UP) {
-		case UP_Z:
-			switch (coord) {
-				case 0:	vtxs.back()[0] = ply_get_argument_value(argument); break;
-				case 1:	vtxs.back()[2] = -ply_get_argument_value(argument); break;
-				case 2:	vtxs.back()[1] = ply_get_argument_value(argument); break;
-			}
-			break;
-		default:
-			vtxs.back()[coord] = ply_get_argument_value(argument);
-			break;
-	}	
+	vtxs.back()[coord] = ply_get_argument_value(argument);
     return 1;
 }
 
 // PLY file: read triangle callback function
 int myply_face_cb(p_ply_argument argument) {
 	long length, face_vertex_index, vtxs_length, is_strip;
-	static long v_index_first, v_index_prev, v_index_last, strip_offset=0;
-	static bool have_bad_vertex_err = false;
+	void *pdata;
 
 	ply_get_argument_property(argument, NULL, &length, &face_vertex_index);
-	ply_get_argument_user_data(argument, NULL, &is_strip);
+	ply_get_argument_user_data(argument, &pdata, &is_strip);
+
+	PlyState &ply = *(PlyState *) pdata;
+	vector<SmVector3> &vtxs = ply.vtxs;
+	long &v_index_first = ply.first, &v_index_prev = ply.prev, &v_index_last = ply.last;
+	long &strip_offset = ply.strip_offset;
 
 	// reset strip_offset for new strips or faces.
 	if (face_vertex_index == 0 || face_vertex_index == -1) {
@@ -521,8 +855,8 @@ int myply_face_cb(p_ply_argument argument) {
 				v_index_prev  < 0 || v_index_prev  >= vtxs_length ||
 				v_index_last  < 0 || v_index_last  >= vtxs_length )
 			{
-				if (!have_bad_vertex_err) {
-					have_bad_vertex_err = true;
+				if (!ply.bad_vertex) {
+					ply.bad_vertex = true;
 					cerr << "WARNING: PLY file contains an out of bounds vertex.\n";
 				}
 				return 1;
@@ -532,12 +866,12 @@ int myply_face_cb(p_ply_argument argument) {
 					v_index_last  == v_index_first ) {
 				} else {
 
-					inputmesh.push_back(Triangle());
+					ply.mesh->push_back(Triangle());
 
 					// store the vertex in the current triangle
-					inputmesh.back().v[0] = roty(vtxs.at(v_index_first));
-					inputmesh.back().v[1] = roty(vtxs.at(v_index_prev));
-					inputmesh.back().v[2] = roty(vtxs.at(v_index_last));
+					ply.mesh->back().v[0] = vtxs.at(v_index_first);
+					ply.mesh->back().v[1] = vtxs.at(v_index_prev);
+					ply.mesh->back().v[2] = vtxs.at(v_index_last);
 				}
 			}
 
@@ -553,13 +887,119 @@ int myply_face_cb(p_ply_argument argument) {
 	return 1;
 }
 
-inline SmVector3 roty(SmVector3 pt)
+void set_transform(ArgumentSet &a, const double local[3][4])
 {
-	return SmVector3(
-		args.OPTS_ROT_COS*pt[0] + args.OPTS_ROT_SIN*pt[2],
-		pt[1],
-		-args.OPTS_ROT_SIN*pt[0] + args.OPTS_ROT_COS*pt[2]
-		);
+	double rot[3][4], m[3][4];
+	unsigned char i, j;
+
+	rotate_transform(SmVector3(0.0, 1.0, 0.0), a.OPTS_ROT, rot);
+	multiply_transform(rot, local, a.OPTS_XFORM);
+
+	if(a.OPTS_ANGLE != 0.0) {
+		rotate_transform(a.OPTS_AXIS, a.OPTS_ANGLE, rot);
+		multiply_transform(rot, a.OPTS_XFORM, m);
+		memcpy(a.OPTS_XFORM, m, sizeof(m));
+	}
+
+	for(i = 0; i < 3; i++)
+		for(j = 0; j < 4; j++)
+			a.OPTS_XFORM[i][j] *= a.OPTS_STRETCH[i];
+}
+
+void up_transform(const ArgumentSet &a, double m[3][4])
+{
+	memset(m, 0, 3*sizeof(m[0]));
+	switch (a.OPTS_UP) {
+		case UP_Z:
+			// (x, y, z) -> (x, z, -y)
+			m[0][0] = 1.0;
+			m[1][2] = 1.0;
+			m[2][1] = -1.0;
+			break;
+		default:
+			m[0][0] = m[1][1] = m[2][2] = 1.0;
+			break;
+	}
+}
+
+void rotate_transform(SmVector3 axis, double angle, double m[3][4])
+{
+	double c = cos(angle*PI/180.0), s = sin(angle*PI/180.0);
+	unsigned char i, j;
+
+	memset(m, 0, 3*sizeof(m[0]));
+	normalize(axis);
+
+	// about the y axis, keep y exact
+	if(axis[0] == 0.0 && axis[2] == 0.0) {
+		if(axis[1] < 0.0) s = -s;
+		m[0][0] = c;  m[0][2] = s;
+		m[1][1] = 1.0;
+		m[2][0] = -s; m[2][2] = c;
+		return;
+	}
+
+	// Rodrigues' rotation formula
+	for(i = 0; i < 3; i++)
+		for(j = 0; j < 3; j++)
+			m[i][j] = (1.0 - c)*axis[i]*axis[j] + ((i == j) ? c : 0.0);
+	m[0][1] -= s*axis[2]; m[1][0] += s*axis[2];
+	m[2][0] -= s*axis[1]; m[0][2] += s*axis[1];
+	m[1][2] -= s*axis[0]; m[2][1] += s*axis[0];
+}
+
+void multiply_transform(const double a[3][4], const double b[3][4], double r[3][4])
+{
+	unsigned char i, j;
+
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 4; j++)
+			r[i][j] = a[i][0]*b[0][j] + a[i][1]*b[1][j] + a[i][2]*b[2][j];
+		r[i][3] += a[i][3];
+	}
+}
+
+void transform_mesh(vector<Triangle> &mesh, size_t first, vector<CloudPoint> &points, size_t firstpoint, const ArgumentSet &a)
+{
+	const double (*m)[4] = a.OPTS_XFORM;
+	SmVector3P col[4], ncol[3];
+	SmVector3 tmp;
+	double cof[3][3], det;
+	size_t i;
+	unsigned char j;
+
+	// the columns of the transform, and of its cofactor matrix for normals
+	for(j = 0; j < 4; j++)
+		col[j] = SmVector3P(m[0][j], m[1][j], m[2][j]);
+	for(j = 0; j < 3; j++) {
+		cof[j][0] = m[(j+1)%3][1]*m[(j+2)%3][2] - m[(j+1)%3][2]*m[(j+2)%3][1];
+		cof[j][1] = m[(j+1)%3][2]*m[(j+2)%3][0] - m[(j+1)%3][0]*m[(j+2)%3][2];
+		cof[j][2] = m[(j+1)%3][0]*m[(j+2)%3][1] - m[(j+1)%3][1]*m[(j+2)%3][0];
+	}
+	det = m[0][0]*cof[0][0] + m[0][1]*cof[0][1] + m[0][2]*cof[0][2];
+	for(j = 0; j < 3; j++)
+		ncol[j] = SmVector3P(cof[0][j], cof[1][j], cof[2][j]) * ((det < 0.0) ? -1.0 : 1.0);
+
+	for(i = first; i < mesh.size(); i++) {
+		Triangle &t = mesh[i];
+		for(j = 0; j < 3; j++)
+			t.v[j] = col[0]*t.v[j][0] + col[1]*t.v[j][1] + col[2]*t.v[j][2] + col[3];
+		// a mirrored face has to be flipped to keep facing outward
+		if(det < 0.0) {
+			tmp = t.v[1];
+			t.v[1] = t.v[2];
+			t.v[2] = tmp;
+		}
+	}
+
+	for(i = firstpoint; i < points.size(); i++) {
+		CloudPoint &p = points[i];
+		p.p = col[0]*p.p[0] + col[1]*p.p[1] + col[2]*p.p[2] + col[3];
+		if(p.n != SmVector3()) {
+			p.n = ncol[0]*p.n[0] + ncol[1]*p.n[1] + ncol[2]*p.n[2];
+			normalize(p.n);
+		}
+	}
 }
 
 
@@ -569,53 +1009,45 @@ inline SmVector3 roty(SmVector3 pt)
 #define STL_FLOAT   4
 #define STL_LONG    4
 #define STL_INT     2
+#define STL_FACET  50
 
-bool load_triangles_stl(char *fname)
+bool load_triangles_stl(char *fname, vector<Triangle> &mesh)
 {
-	long begin, end;
-	unsigned long nfacets;
+	unsigned long long size;
+	unsigned int nfacets;
 	unsigned char i;
 	float vtx[3];
-
-	ifstream stl(fname, ios::in | ios::binary);
-	if(stl.good()) {
-		// skip the 80 byte header
-		stl.seekg(STL_HEADER, ios::beg);
-		// get the number of triangles
-		stl.read((char *) &nfacets, STL_LONG);
-		// get the file size
-		begin = stl.tellg();
-		stl.seekg(0, ios::end);
-		end = stl.tellg();
+	char header[STL_HEADER + STL_LONG], facet[STL_FACET];
+
+	MeshInput stl;
+	if(stl.open(fname)) {
+		// skip the 80 byte header and get the number of triangles
+		if(stl.sgetn(header, sizeof(header)) != sizeof(header)) {
+			if(stl.failed()) cerr << "ERROR: Corrupt compressed file or read error in " << fname << ".\n";
+			return false;
+		}
+		memcpy(&nfacets, header + STL_HEADER, STL_LONG);
 		// check if the file size is correct
 		// for a binary STL file
-		if(nfacets * 50 == (unsigned long)(end-begin)) {
+		size = (unsigned long long) nfacets * STL_FACET + STL_HEADER + STL_LONG;
+		if(stl.iscompressed()) size &= 0xFFFFFFFFULL; // gzip records the size modulo 2^32
+		if(size == stl.size()) {
 			// binary file
-			stl.seekg(STL_HEADER + STL_LONG - STL_INT, ios::beg);
 			for (;nfacets > 0; nfacets--) {
-				inputmesh.push_back(Triangle());
-				// skip normal, attribute byte count
-				stl.seekg(STL_INT + 3*STL_FLOAT, ios::cur);
+				if(stl.sgetn(facet, STL_FACET) != STL_FACET) break;
+				mesh.push_back(Triangle());
+				// skip normal, read vertices, skip attribute byte count
 				for (i = 0; i < 3; i++) {
-					stl.read((char *) &vtx[0],STL_FLOAT);
-					stl.read((char *) &vtx[1],STL_FLOAT);
-					stl.read((char *) &vtx[2],STL_FLOAT);
-					switch (args.OPTS_UP) {
-						case UP_Z:
-							inputmesh.back().v[i] = roty(SmVector3(vtx[0],vtx[2],-vtx[1]));
-							break;
-						default:
-							inputmesh.back().v[i] = roty(SmVector3(vtx[0],vtx[1],vtx[2]));
-							break;
-					}
+					memcpy(vtx, facet + (i+1)*3*STL_FLOAT, 3*STL_FLOAT);
+					mesh.back().v[i] = SmVector3(vtx[0],vtx[1],vtx[2]);
 				}
 			}
-			stl.close();
-			return true;
+			if(stl.failed()) cerr << "ERROR: Corrupt compressed file or read error in " << fname << ".\n";
+			return nfacets == 0 && !stl.failed();
 		} else {
 			// ascii file
 			stl.close();
-			return load_triangles_stla(fname);
+			return load_triangles_stla(fname, mesh);
 		}
 	} else {
 		return false;
@@ -623,57 +1055,294 @@ bool load_triangles_stl(char *fname)
 
 }
 
-bool load_triangles_stla(char *fname)
+bool load_triangles_stla(char *fname, vector<Triangle> &mesh)
 {
 	char str[80];
-	ifstream stl(fname, ios::in);
 	unsigned char i;
 	float vtx[3];
+	bool noerr = true;
+
+	MeshInput input;
+	if(!input.open(fname)) return false;
+	istream stl(&input);
 
 	while(stl.good()) {
 		stl >> str;
 		if(strstr(str, "facet") && !strstr(str, "endfacet")) {
-			inputmesh.push_back(Triangle());
+			mesh.push_back(Triangle());
 			i = 0;
 			while(i < 3 && !strstr(str, "endfacet") && stl.good()) {
 				stl >> str;
 				if(strstr(str, "vertex")) {
 					stl >> vtx[0] >> vtx[1] >> vtx[2];
-					switch (args.OPTS_UP) {
-						case UP_Z:
-							inputmesh.back().v[i] = roty(SmVector3(vtx[0],vtx[2],-vtx[1]));
-							break;
-						default:
-							inputmesh.back().v[i] = roty(SmVector3(vtx[0],vtx[1],vtx[2]));
-							break;
-					}
+					mesh.back().v[i] = SmVector3(vtx[0],vtx[1],vtx[2]);
 					i++;
 				}
 			}
-			if (i < 3) return false;
+			if (i < 3) {
+				noerr = false;
+				break;
+			}
+		}
+	}
+	if(input.failed()) {
+		cerr << "ERROR: Corrupt compressed file or read error in " << fname << ".\n";
+		return false;
+	}
+	return noerr;
+}
+
+unsigned long long mesh_cache_hash(char *fname)
+{
+	// 64 bit FNV-1a, taken a word at a time over the file contents
+	const unsigned long long prime = 1099511628211ULL;
+	unsigned long long hash = 14695981039346656037ULL, word;
+	qint64 size, pos, n;
+	uchar *data;
+	char buf[1 << 16];
+	unsigned char i, j;
+
+	QFile src(fname);
+	if(!src.open(QIODevice::ReadOnly))
+		return 0;
+	size = src.size();
+
+	if((data = src.map(0, size)) != 0) {
+		for(pos = 0; pos + 8 <= size; pos += 8) {
+			memcpy(&word, data + pos, 8);
+			hash = (hash ^ word) * prime;
+		}
+		for(; pos < size; pos++)
+			hash = (hash ^ data[pos]) * prime;
+		src.unmap(data);
+	} else {
+		// mapping is not available, so read the file in blocks
+		while((n = src.read(buf, sizeof(buf))) > 0) {
+			for(pos = 0; pos + 8 <= n; pos += 8) {
+				memcpy(&word, buf + pos, 8);
+				hash = (hash ^ word) * prime;
+			}
+			for(; pos < n; pos++)
+				hash = (hash ^ (unsigned char) buf[pos]) * prime;
+		}
+	}
+
+	// options applied while loading change the cached triangles
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 4; j++) {
+			memcpy(&word, &args.OPTS_XFORM[i][j], 8);
+			hash = (hash ^ word) * prime;
 		}
 	}
+	hash = (hash ^ args.OPTS_FORMAT) * prime;
+	hash = (hash ^ size) * prime;
+
+	return hash;
+}
+
+bool load_mesh_cache(char *fname, unsigned long long hash)
+{
+	MeshCacheHeader hdr;
+	qint64 size;
+	uchar *data;
+	const double *r;
+	unsigned long long n;
+	unsigned char j;
+
+	QFile cache(QString(fname).append(MESHCACHE_EXT));
+	if(!cache.exists() || !cache.open(QIODevice::ReadOnly))
+		return false;
+	size = cache.size();
+	if(size < (qint64) sizeof(hdr) || (data = cache.map(0, size)) == 0)
+		return false;
+
+	// check that the cache belongs to this file and these options
+	memcpy(&hdr, data, sizeof(hdr));
+	if(memcmp(hdr.magic, MESHCACHE_MAGIC, sizeof(hdr.magic)) != 0 || hdr.hash != hash ||
+		(unsigned long long) size != sizeof(hdr) + hdr.ntriangles*MESHCACHE_RECORD*sizeof(double)) {
+		cache.unmap(data);
+		return false;
+	}
+
+	inputmesh.resize(hdr.ntriangles);
+	r = (const double *) (data + sizeof(hdr));
+	for(n = 0; n < hdr.ntriangles; n++) {
+		Triangle &t = inputmesh[n];
+		for(j = 0; j < 3; j++, r += 3)
+			t.v[j] = SmVector3(r[0], r[1], r[2]);
+		t.an = SmVector3(r[0], r[1], r[2]);  r += 3;
+		t.un = SmVector3(r[0], r[1], r[2]);  r += 3;
+		t.mn = SmVector3(r[0], r[1], r[2]);  r += 3;
+		t.mx = SmVector3(r[0], r[1], r[2]);  r += 3;
+	}
+
+	cache.unmap(data);
 	return true;
 }
 
-bool mesh_bounds(SmVector3 &mn, SmVector3 &mx)
+bool save_mesh_cache(char *fname, unsigned long long hash)
 {
-	SmVector3 tmin, tmax, sz;
+	MeshCacheHeader hdr;
+	vector<double> buf;
+	vector<Triangle>::iterator i;
+	unsigned char j, k;
+	bool noerr;
+
+	QFile cache(QString(fname).append(MESHCACHE_EXT));
+	if(!cache.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	memcpy(hdr.magic, MESHCACHE_MAGIC, sizeof(hdr.magic));
+	hdr.hash = hash;
+	hdr.ntriangles = inputmesh.size();
+	noerr = cache.write((const char *) &hdr, sizeof(hdr)) == (qint64) sizeof(hdr);
+
+	// write the records in blocks of 4096 triangles
+	buf.reserve(4096*MESHCACHE_RECORD);
+	for(i = inputmesh.begin(); noerr && i != inputmesh.end(); ) {
+		buf.clear();
+		for(; i != inputmesh.end() && buf.size() < buf.capacity(); i++) {
+			for(j = 0; j < 3; j++)
+				for(k = 0; k < 3; k++) buf.push_back((*i).v[j][k]);
+			for(k = 0; k < 3; k++) buf.push_back((*i).an[k]);
+			for(k = 0; k < 3; k++) buf.push_back((*i).un[k]);
+			for(k = 0; k < 3; k++) buf.push_back((*i).mn[k]);
+			for(k = 0; k < 3; k++) buf.push_back((*i).mx[k]);
+		}
+		noerr = cache.write((const char *) &buf[0], buf.size()*sizeof(double)) == (qint64) (buf.size()*sizeof(double));
+	}
+
+	cache.close();
+	if(!noerr) cache.remove();
+	return noerr;
+}
+
+void BoundsWorker::run()
+{
+	bounds();
+}
+
+void BoundsWorker::bounds()
+{
+	TriangleSoA soa;
+	SmVector3P lo, hi;
+	SmVector3 tmin, tmax;
+	size_t i;
+	double a;
 
 	// calculate the normals, bounding boxes for each triangle
-	for(vector<Triangle>::iterator i = inputmesh.begin(); i != inputmesh.end(); i++) {
-		(*i).computenormal();
-		(*i).computebounds(tmin, tmax);
+	// unless they were read from the mesh cache
+	for(i = first; i < last; i++) {
+		Triangle &t = inputmesh[i];
+		if(meshprepared) {
+			tmin = t.mn;
+			tmax = t.mx;
+		} else {
+			// faces are computed a block at a time.  Compacting the
+			// range only writes to faces already copied to the block
+			if((i - first) % SOA_BLOCK == 0) {
+				soa.assign(inputmesh, i, last);
+				soa.computenormals();
+				soa.computebounds();
+			}
+
+			// cull triangles without area, which would get a NaN normal,
+			// and slivers that are too thin to be hit by a ray
+			TriangleView f = soa[(i - first) % SOA_BLOCK];
+			a = f.area();
+			if(!(a > 0.0)) {
+				zero++;
+				continue;
+			}
+			if(a <= SLIVER_RATIO * f.longestedge()) {
+				sliver++;
+				continue;
+			}
+			f.store(t);
+			tmin = t.mn;
+			tmax = t.mx;
+		}
 		
-		if(i == inputmesh.begin()) {
-			mn = tmin;
-			mx = tmax;
+		if(kept == 0) {
+			lo = tmin;
+			hi = tmax;
+		} else {
+			// update bounding box for the range
+			lo.minSet(tmin);
+			hi.maxSet(tmax);
+		}
+		if(first + kept != i) inputmesh[first + kept] = t;
+		kept++;
+	}
+	mn = lo;
+	mx = hi;
+}
+
+bool mesh_bounds(SmVector3 &mn, SmVector3 &mx)
+{
+	SmVector3 sz;
+	SmVector3P lo, hi;
+	vector<BoundsWorker *> workers;
+	size_t i, k, n, chunk, zero = 0, sliver = 0;
+	int threads;
+
+	// split the mesh between the threads, keeping small meshes on one
+	n = inputmesh.size();
+	threads = max(1, min(QThread::idealThreadCount(), int((n + BOUNDS_CHUNK - 1) / BOUNDS_CHUNK)));
+	chunk = (n + threads - 1) / threads;
+	for(i = 0; i < (size_t) threads; i++)
+		workers.push_back(new BoundsWorker(min(n, i*chunk), min(n, (i+1)*chunk)));
+
+	if(threads == 1) {
+		workers[0]->bounds();
+	} else {
+		for(i = 0; i < workers.size(); i++)
+			workers[i]->start();
+		for(i = 0; i < workers.size(); i++)
+			workers[i]->wait();
+	}
+
+	// close the gaps left by culled faces, keeping the mesh in order,
+	// and combine the bounding boxes of the ranges
+	for(i = 0, k = 0; i < workers.size(); i++) {
+		BoundsWorker &w = *workers[i];
+		if(k != w.first)
+			copy(inputmesh.begin() + w.first, inputmesh.begin() + w.first + w.kept, inputmesh.begin() + k);
+		if(w.kept) {
+			if(k == 0) {
+				lo = w.mn;
+				hi = w.mx;
+			} else {
+				lo.minSet(w.mn);
+				hi.maxSet(w.mx);
+			}
+		}
+		k += w.kept;
+		zero += w.zero;
+		sliver += w.sliver;
+		delete workers[i];
+	}
+	inputmesh.resize(k);
+
+	// points of a point cloud only add their position
+	for(i = 0; i < inputpoints.size(); i++, k++) {
+		if(k == 0) {
+			lo = inputpoints[i].p;
+			hi = inputpoints[i].p;
 		} else {
-			// update bounding box for total mesh
-			mn.minSet(tmin);
-			mx.maxSet(tmax);
+			lo.minSet(inputpoints[i].p);
+			hi.maxSet(inputpoints[i].p);
 		}
 	}
+	mn = lo;
+	mx = hi;
+
+	if((zero || sliver) && args.OPTS_MESSAGE==MESSAGE_ALL)
+		cout << now() << "\t: culled " << zero << " zero area and " << sliver << " sliver triangles" << endl;
+	if(inputmesh.empty() && inputpoints.empty()) {
+		if(args.OPTS_MESSAGE) cerr << "ERROR: The mesh has no triangles." << endl;
+		return false;
+	}
 
 	// size of the mesh
 	sz = mx - mn;
@@ -690,7 +1359,7 @@ bool mesh_bounds(SmVector3 &mn, SmVector3 &mx)
 	sz = mx + args.OPTS_OFFSET;
 
     args.meshsize = max(sz[0],max(sz[1],sz[2]));
-    if(args.meshsize / (SPCUBE_WIDTH*args.OPTS_SCALE) > (1 << (sizeof(SpCubeCoord)*CHAR_BIT-1))) {
+    if(args.meshsize / (SPCUBE_WIDTH*args.OPTS_SCALE) > SPCUBE_MAX) {
 		if(args.OPTS_MESSAGE) cerr << "ERROR: The mesh is larger than the maximum allowed stud length." << endl
                         << "  Try re-centering the mesh at the origin, or check your scale settings" << endl;
 		return false;
@@ -698,7 +1367,7 @@ bool mesh_bounds(SmVector3 &mn, SmVector3 &mx)
 	// check if the mesh is too big in - direction
 	sz = mn + args.OPTS_OFFSET;
     args.meshsize = -min(sz[0],min(sz[1],sz[2]));
-    if(args.meshsize / (SPCUBE_WIDTH*args.OPTS_SCALE) > (1 << (sizeof(SpCubeCoord)*CHAR_BIT-1))) {
+    if(args.meshsize / (SPCUBE_WIDTH*args.OPTS_SCALE) > SPCUBE_MAX) {
 		if(args.OPTS_MESSAGE) cerr << "ERROR: The mesh is larger than the maximum allowed stud length." << endl
                         << "  Try re-centering the mesh at the origin, or check your scale settings"  << endl;
 		return false;
@@ -707,44 +1376,504 @@ bool mesh_bounds(SmVector3 &mn, SmVector3 &mx)
 	return true;  // success
 }
 
+void weld_mesh()
+{
+	vector<int>          bucket, chain;
+	unsigned long        mask;
+	long                 cell[3], c[3];
+	double               dist, dist2;
+	unsigned int         i, j, k, n, degenerate, duplicate;
+	int                  p;
+
+	n = inputmesh.size();
+	meshvtxs.clear();
+	meshfaces.clear();
+	meshvtxs.reserve(n);
+	meshfaces.reserve(3*n);
+
+	// grid cells are as wide as the welding distance, so a match
+	// is always in the same or a neighboring cell
+	dist = args.OPTS_WELD * VOXEL_HEIGHT * args.OPTS_SCALE;
+	dist2 = dist * dist;
+	for(mask = 1; mask < 2*n; mask <<= 1);
+	bucket.assign(mask, -1);
+	chain.reserve(n);
+	mask--;
+
+	for(i = 0; i < n; i++) {
+		for(j = 0; j < 3; j++) {
+			const SmVector3 &v = inputmesh[i].v[j];
+			for(k = 0; k < 3; k++)
+				cell[k] = (long) floor(v[k] / dist);
+
+			// look for a vertex to weld to in the 27 surrounding cells
+			p = -1;
+			for(c[0] = cell[0]-1; p < 0 && c[0] <= cell[0]+1; c[0]++)
+				for(c[1] = cell[1]-1; p < 0 && c[1] <= cell[1]+1; c[1]++)
+					for(c[2] = cell[2]-1; p < 0 && c[2] <= cell[2]+1; c[2]++) {
+						for(p = bucket[cell_hash(c, mask)]; p >= 0; p = chain[p])
+							if(sqrMag(meshvtxs[p] - v) <= dist2) break;
+					}
+
+			if(p < 0) {
+				p = meshvtxs.size();
+				meshvtxs.push_back(v);
+				chain.push_back(bucket[cell_hash(cell, mask)]);
+				bucket[cell_hash(cell, mask)] = p;
+			}
+			meshfaces.push_back(p);
+		}
+	}
+
+	rebuild_mesh(degenerate, duplicate);
+
+	if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: welded " << 3*n << " vertices into " << meshvtxs.size()
+		<< ", removed " << degenerate << " collapsed and " << duplicate << " duplicate triangles" << endl;
+}
+
+void decimate_mesh()
+{
+	vector<int>          bucket, chain, cluster;
+	vector<long>         cells;
+	vector<SmVector3>    sum;
+	vector<unsigned int> count;
+	unsigned long        mask;
+	long                 cell[3];
+	double               size;
+	unsigned int         i, k, n, degenerate, duplicate;
+	int                  p;
+
+	n = inputmesh.size();
+
+	// cluster the welded vertices, or every corner if welding is off
+	if(meshfaces.size() != 3*inputmesh.size()) {
+		meshvtxs.clear();
+		meshfaces.clear();
+		for(i = 0; i < n; i++)
+			for(k = 0; k < 3; k++) {
+				meshfaces.push_back(meshvtxs.size());
+				meshvtxs.push_back(inputmesh[i].v[k]);
+			}
+	}
+
+	// every vertex in a grid cell is replaced by the average
+	// of the vertices in that cell
+	size = args.OPTS_DECIMATE * VOXEL_HEIGHT * args.OPTS_SCALE;
+	for(mask = 1; mask < 2*meshvtxs.size(); mask <<= 1);
+	bucket.assign(mask, -1);
+	mask--;
+	cluster.resize(meshvtxs.size());
+
+	for(i = 0; i < meshvtxs.size(); i++) {
+		for(k = 0; k < 3; k++)
+			cell[k] = (long) floor(meshvtxs[i][k] / size);
+		for(p = bucket[cell_hash(cell, mask)]; p >= 0; p = chain[p])
+			if(cells[3*p] == cell[0] && cells[3*p+1] == cell[1] && cells[3*p+2] == cell[2]) break;
+		if(p < 0) {
+			p = sum.size();
+			sum.push_back(SmVector3());
+			count.push_back(0);
+			cells.insert(cells.end(), cell, cell + 3);
+			chain.push_back(bucket[cell_hash(cell, mask)]);
+			bucket[cell_hash(cell, mask)] = p;
+		}
+		sum[p] += meshvtxs[i];
+		count[p]++;
+		cluster[i] = p;
+	}
+
+	meshvtxs.resize(sum.size());
+	for(i = 0; i < sum.size(); i++)
+		meshvtxs[i] = sum[i] / count[i];
+	for(i = 0; i < meshfaces.size(); i++)
+		meshfaces[i] = cluster[meshfaces[i]];
+
+	rebuild_mesh(degenerate, duplicate);
+
+	if(args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: decimated " << n << " triangles to " << inputmesh.size()
+		<< " on " << meshvtxs.size() << " vertices" << endl;
+}
+
+void rebuild_mesh(unsigned int &degenerate, unsigned int &duplicate)
+{
+	vector<unsigned int> order;
+	vector<bool>         keep;
+	unsigned int         i, j, k, n;
+	SmVector3            tmin, tmax;
+
+	n = meshfaces.size() / 3;
+	degenerate = duplicate = 0;
+
+	// drop faces that collapsed, then sort the rest by their vertices,
+	// starting each face at its lowest index so that the winding is kept,
+	// to find exact duplicates
+	keep.assign(n, true);
+	order.reserve(n);
+	for(i = 0; i < n; i++) {
+		unsigned int *f = &meshfaces[3*i];
+		if(f[0] == f[1] || f[1] == f[2] || f[2] == f[0]) {
+			keep[i] = false;
+			degenerate++;
+			continue;
+		}
+		while(f[0] > f[1] || f[0] > f[2]) {
+			unsigned int t = f[0];
+			f[0] = f[1]; f[1] = f[2]; f[2] = t;
+		}
+		order.push_back(i);
+	}
+	sort(order.begin(), order.end(), FaceOrder(meshfaces));
+	for(i = 1; i < order.size(); i++) {
+		if(memcmp(&meshfaces[3*order[i]], &meshfaces[3*order[i-1]], 3*sizeof(unsigned int)) == 0) {
+			keep[order[i]] = false;
+			duplicate++;
+		}
+	}
+
+	// rebuild the triangle list from the shared vertices, dropping
+	// faces that became flat when their vertices moved
+	for(i = 0, k = 0; i < n; i++) {
+		if(!keep[i]) continue;
+		for(j = 0; j < 3; j++) {
+			meshfaces[3*k + j] = meshfaces[3*i + j];
+			inputmesh[k].v[j] = meshvtxs[meshfaces[3*i + j]];
+		}
+		if(!(mag(inputmesh[k].computenormal(true)) > 0.0)) {
+			degenerate++;
+			continue;
+		}
+		inputmesh[k].computebounds(tmin, tmax);
+		k++;
+	}
+	inputmesh.resize(k);
+	meshfaces.resize(3*k);
+}
+
+inline unsigned long cell_hash(const long cell[3], unsigned long mask)
+{
+	return ((unsigned long) cell[0]*73856093UL ^ (unsigned long) cell[1]*19349663UL ^ (unsigned long) cell[2]*83492791UL) & mask;
+}
+
+void estimate_point_normals()
+{
+	vector<int>          bucket, chain;
+	vector<long>         cells;
+	unsigned long        mask;
+	long                 c[3], span;
+	double               radius, r2, cov[3][3];
+	SmVector3            center, mean, d;
+	unsigned int         i, j, k, n, count, estimated = 0;
+	int                  p;
+
+	n = inputpoints.size();
+
+	// grid cells are as wide as the smallest neighborhood, which
+	// is widened a cell at a time in sparse parts of the cloud
+	radius = VOXEL_HEIGHT/2 * args.OPTS_SCALE;
+	for(mask = 1; mask < 2*n; mask <<= 1);
+	bucket.assign(mask, -1);
+	chain.resize(n);
+	cells.resize(3*n);
+	mask--;
+
+	for(i = 0; i < n; i++) {
+		center += inputpoints[i].p;
+		for(k = 0; k < 3; k++)
+			cells[3*i + k] = (long) floor(inputpoints[i].p[k] / radius);
+		chain[i] = bucket[cell_hash(&cells[3*i], mask)];
+		bucket[cell_hash(&cells[3*i], mask)] = i;
+	}
+	center /= n;
+
+	for(i = 0; i < n; i++) {
+		CloudPoint &pt = inputpoints[i];
+		if(pt.n != SmVector3()) continue;
+
+		// covariance of the neighbors, relative to the point
+		for(span = 1, count = 0; count < POINT_NEIGHBORS && span*VOXEL_HEIGHT/2 <= VOXEL_WIDTH; span++) {
+			mean = SmVector3(0.0);
+			memset(cov, 0, sizeof(cov));
+			count = 0;
+			r2 = span*radius * span*radius;
+			for(c[0] = cells[3*i]-span; c[0] <= cells[3*i]+span; c[0]++)
+				for(c[1] = cells[3*i+1]-span; c[1] <= cells[3*i+1]+span; c[1]++)
+					for(c[2] = cells[3*i+2]-span; c[2] <= cells[3*i+2]+span; c[2]++) {
+						for(p = bucket[cell_hash(c, mask)]; p >= 0; p = chain[p]) {
+							// skip points of other cells sharing the bucket
+							if(cells[3*p] != c[0] || cells[3*p+1] != c[1] || cells[3*p+2] != c[2]) continue;
+							d = inputpoints[p].p - pt.p;
+							if(sqrMag(d) > r2) continue;
+							mean += d;
+							for(j = 0; j < 3; j++)
+								for(k = 0; k < 3; k++)
+									cov[j][k] += d[j]*d[k];
+							count++;
+						}
+					}
+		}
+
+		// the normal of the best fitting plane, or the direction from
+		// the center if there are too few neighbors to fit a plane
+		if(count >= 3) {
+			mean /= count;
+			for(j = 0; j < 3; j++)
+				for(k = 0; k < 3; k++)
+					cov[j][k] = cov[j][k] / count - mean[j]*mean[k];
+			pt.n = smallest_eigenvector(cov);
+		} else {
+			pt.n = pt.p - center;
+		}
+		if(dot(pt.n, pt.p - center) < 0.0)
+			pt.n = -pt.n;
+		normalize(pt.n);
+		estimated++;
+	}
+
+	if(estimated && args.OPTS_MESSAGE==MESSAGE_ALL) cout << now() << "\t: estimated normals of " << estimated << " points" << endl;
+}
+
+SmVector3 smallest_eigenvector(double a[3][3])
+{
+	double v[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+	double theta, t, c, s, x, y;
+	unsigned char sweep, p, q, k, m;
+
+	for(sweep = 0; sweep < 32; sweep++) {
+		if(a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2] <=
+		   1e-24 * (a[0][0]*a[0][0] + a[1][1]*a[1][1] + a[2][2]*a[2][2])) break;
+
+		// rotate away each off diagonal element in turn
+		for(p = 0; p < 2; p++) {
+			for(q = p+1; q < 3; q++) {
+				if(a[p][q] == 0.0) continue;
+				theta = (a[q][q] - a[p][p]) / (2.0*a[p][q]);
+				t = ((theta < 0.0) ? -1.0 : 1.0) / (fabs(theta) + sqrt(theta*theta + 1.0));
+				c = 1.0 / sqrt(t*t + 1.0);
+				s = t*c;
+				for(k = 0; k < 3; k++) {
+					x = a[k][p]; y = a[k][q];
+					a[k][p] = c*x - s*y;
+					a[k][q] = s*x + c*y;
+				}
+				for(k = 0; k < 3; k++) {
+					x = a[p][k]; y = a[q][k];
+					a[p][k] = c*x - s*y;
+					a[q][k] = s*x + c*y;
+				}
+				for(k = 0; k < 3; k++) {
+					x = v[k][p]; y = v[k][q];
+					v[k][p] = c*x - s*y;
+					v[k][q] = s*x + c*y;
+				}
+			}
+		}
+	}
+
+	// the eigenvalues are left on the diagonal
+	m = (a[0][0] <= a[1][1]) ? 0 : 1;
+	if(a[2][2] < a[m][m]) m = 2;
+	return SmVector3(v[0][m], v[1][m], v[2][m]);
+}
+
+void PartitionWorker::run()
+{
+	if(scattering)
+		scatter();
+	else
+		bin();
+}
+
+void PartitionWorker::bin()
+{
+	SpCubeKey mn, mx, k;
+	double    half = (SPCUBE_WIDTH/2.0 + SPCUBE_PAD) * args.OPTS_SCALE;
+	bool      exact;
+
+	keys.clear();
+	ends.clear();
+	ends.reserve(last - first);
+	for(size_t i = first; i < last; i++) {
+		const Triangle &t = inputmesh[i];
+		exact = face_cubes(t, mn, mx);
+
+		for(k[0] = mn[0]; k[0] < mx[0]; k[0]++) {
+			for(k[1] = mn[1]; k[1] < mx[1]; k[1]++) {
+				for(k[2] = mn[2]; k[2] < mx[2]; k[2]++) {
+					if(exact && !t.overlap(cube_center(k), half)) continue;
+					keys.push_back(k);
+				}
+			}
+		}
+		ends.push_back(keys.size());
+	}
+}
+
+void PartitionWorker::scatter()
+{
+	size_t i, e = 0;
+
+	for(i = first; i < last; i++)
+		for(; e < ends[i - first]; e++)
+			cubefaces[(*firsts)[cubes[e]] + places[e]] = i;
+}
+
 void partition_space()
 {
-	SpCube      cube;
 	SpCubeKey   mn, mx, k;
 	SmVector3   loc;
 	double      scale = 1.0 / (args.OPTS_SCALE * SPCUBE_WIDTH),
 		        pad = double(SPCUBE_PAD) / SPCUBE_WIDTH;
-
+	SmVector3P  offset(args.OPTS_OFFSET), lo(HUGE_VAL), hi(-HUGE_VAL);
+	vector<PartitionWorker *> workers;
+	vector<unsigned int> counts, previous, firsts;
+	SpCubeTable::iterator c;
+	size_t      i, e, n, chunk;
+	int         threads;
+
+	// the box of cubes reached by the mesh, with a cube to spare
+	// on each side for rounding
 	for(vector<Triangle>::iterator i = inputmesh.begin(); i != inputmesh.end(); i++) {
-		loc = (*i).mx + args.OPTS_OFFSET;
+		lo.minSet((*i).mn);
+		hi.maxSet((*i).mx);
+	}
+	for(vector<CloudPoint>::iterator p = inputpoints.begin(); p != inputpoints.end(); p++) {
+		lo.minSet((*p).p);
+		hi.maxSet((*p).p);
+	}
+	if(!inputmesh.empty() || !inputpoints.empty()) {
+		loc = (lo + offset) * scale - pad;
+		mn = SpCubeKey((int) floor(loc[0]) - 1, (int) floor(loc[1]) - 1, (int) floor(loc[2]) - 1);
+		loc = (hi + offset) * scale + pad;
+		mx = SpCubeKey((int) ceil(loc[0]) + 2, (int) ceil(loc[1]) + 2, (int) ceil(loc[2]) + 2);
+		cubelist.bound(mn, mx, args.OPTS_DENSE);
+	}
+
+	// split the mesh between the threads, keeping small meshes on one
+	n = inputmesh.size();
+	threads = max(1, min(QThread::idealThreadCount(), int((n + PARTITION_CHUNK - 1) / PARTITION_CHUNK)));
+	chunk = (n + threads - 1) / threads;
+	for(i = 0; i < (size_t) threads; i++)
+		workers.push_back(new PartitionWorker(min(n, i*chunk), min(n, (i+1)*chunk)));
+
+	// first pass: each thread finds the cubes of its faces
+	if(threads == 1) {
+		workers[0]->bin();
+	} else {
+		for(i = 0; i < workers.size(); i++)
+			workers[i]->start();
+		for(i = 0; i < workers.size(); i++)
+			workers[i]->wait();
+	}
+
+	// add the cubes and count their faces in the order of the mesh,
+	// which gives each face its place in the face lists
+	for(i = 0; i < workers.size(); i++) {
+		PartitionWorker &w = *workers[i];
+		w.cubes.resize(w.keys.size());
+		w.places.resize(w.keys.size());
+		for(e = 0; e < w.keys.size(); e++) {
+			c = cubelist.insert(w.keys[e]);
+			if(c.position() >= counts.size())
+				counts.resize(c.position() + 1, 0);
+			w.cubes[e] = c.position();
+			w.places[e] = counts[c.position()]++;
+		}
+		vector<SpCubeKey>().swap(w.keys);
+	}
+
+	// a point is binned like a triangle with a point sized bounding box,
+	// before the reorder so that its cubes are in z-order too
+	for(vector<CloudPoint>::iterator p = inputpoints.begin(); p != inputpoints.end(); p++) {
+		loc = (*p).p + args.OPTS_OFFSET;
 		mx[0] = ceil(loc[0] * scale + pad);
 		mx[1] = ceil(loc[1] * scale + pad);
 		mx[2] = ceil(loc[2] * scale + pad);
 
-		loc = (*i).mn + args.OPTS_OFFSET;
 		mn[0] = floor(loc[0] * scale - pad);
 		mn[1] = floor(loc[1] * scale - pad);
 		mn[2] = floor(loc[2] * scale - pad);
 
-		mx[0] += (mx[0]==mn[0]) ? 1 : 0;
-		mx[1] += (mx[1]==mn[1]) ? 1 : 0;
-		mx[2] += (mx[2]==mn[2]) ? 1 : 0; 
-
 		for(k[0] = mn[0]; k[0] < mx[0]; k[0]++) {
 			for(k[1] = mn[1]; k[1] < mx[1]; k[1]++) {
 				for(k[2] = mn[2]; k[2] < mx[2]; k[2]++) {
-					cubelist[k].tlist.push_back(&(*i));
+					c = cubelist.insert(k);
+					if(c.position() >= counts.size())
+						counts.resize(c.position() + 1, 0);
+					(*c).second.plist.push_back(&(*p));
 				}
 			}
 		}
 	}
+
+	// keep the cubes in z-order, and the prefix sum of the counts
+	// in the same order places the faces of each cube
+	cubelist.reorder(previous);
+	firsts.resize(counts.size());
+	for(c = cubelist.begin(), e = 0; c != cubelist.end(); c++) {
+		i = previous[c.position()];
+		(*c).second.tfirst = firsts[i] = e;
+		(*c).second.tcount = counts[i];
+		e += counts[i];
+	}
+	cubefaces.resize(e);
+
+	// second pass: each thread writes its faces into the lists
+	if(threads == 1) {
+		workers[0]->firsts = &firsts;
+		workers[0]->scatter();
+	} else {
+		for(i = 0; i < workers.size(); i++) {
+			workers[i]->firsts = &firsts;
+			workers[i]->scattering = true;
+			workers[i]->start();
+		}
+		for(i = 0; i < workers.size(); i++)
+			workers[i]->wait();
+	}
+	for(i = 0; i < workers.size(); i++)
+		delete workers[i];
+}
+
+inline bool face_cubes(const Triangle &t, SpCubeKey &mn, SpCubeKey &mx)
+{
+	double scale = 1.0 / (args.OPTS_SCALE * SPCUBE_WIDTH),
+		pad = double(SPCUBE_PAD) / SPCUBE_WIDTH;
+	SmVector3P offset(args.OPTS_OFFSET), loc;
+	unsigned char d, wide = 0;
+
+	loc = (SmVector3P(t.mx) + offset) * scale + pad;
+	mx[0] = ceil(loc[0]);
+	mx[1] = ceil(loc[1]);
+	mx[2] = ceil(loc[2]);
+
+	loc = (SmVector3P(t.mn) + offset) * scale - pad;
+	mn[0] = floor(loc[0]);
+	mn[1] = floor(loc[1]);
+	mn[2] = floor(loc[2]);
+
+	for(d = 0; d < 3; d++) {
+		mx[d] += (mx[d]==mn[d]) ? 1 : 0;
+		wide += (mx[d] - mn[d] > 1) ? 1 : 0;
+	}
+
+	// a box one cube wide in two axes lies in a single column of
+	// cubes, and a face crosses every cube of its column it spans.
+	// Without OPTS_EXACT every cube of the box gets the face: the
+	// fill relies on the cubes next to the surface that this makes
+	return args.OPTS_EXACT && wide > 1;
+}
+
+inline SmVector3 cube_center(const SpCubeKey &k)
+{
+	return SmVector3(k[0] + 0.5, k[1] + 0.5, k[2] + 0.5)*args.OPTS_SCALE*SPCUBE_WIDTH - args.OPTS_OFFSET;
 }
 
 void compute_cube_normals()
 {
-	SmVector3 nabs, navg;
-	map<SpCubeKey, SpCube>::iterator c;
-	vector<Triangle *>::iterator t;
+	SmVector3P nabs, navg;
+	SpCubeTable::iterator c;
+	unsigned int t, tend;
+	vector<CloudPoint *>::iterator p;
 	double maxdir;
 	unsigned char orient;
 	bool neg;
@@ -756,12 +1885,21 @@ void compute_cube_normals()
 
 		// sum the area weighted normal vectors for each triangle.
 		// also sum the abs value of the normal vectors
-		nabs = SmVector3(0.0);
-		navg = SmVector3(0.0);
+		nabs = SmVector3P(0.0);
+		navg = SmVector3P(0.0);
+
+		tend = (*c).second.tfirst + (*c).second.tcount;
+		for(t = (*c).second.tfirst; t < tend; t++) {
+			SmVector3P an(inputmesh[cubefaces[t]].an);
+			nabs += abs(an);
+			navg += an;
+		}
 
-		for(t = (*c).second.tlist.begin(); t != (*c).second.tlist.end(); t++) {
-			nabs += abs((*t)->an);
-			navg += (*t)->an;
+		// each point counts with its unit normal
+		for(p = (*c).second.plist.begin(); p != (*c).second.plist.end(); p++) {
+			SmVector3P n((*p)->n);
+			nabs += abs(n);
+			navg += n;
 		}
 
 		// if sum(abs) > abs(sum) for any component then there are
@@ -783,13 +1921,22 @@ void compute_cube_normals()
 		// biggest direction is a "thin" direction
 		if( (*c).second.isthin(orient) ) {
 			neg = (navg[orient] < 0.0);
-			navg = SmVector3(0.0);
-			for(t = (*c).second.tlist.begin(); t != (*c).second.tlist.end(); t++) {
-				if ( (!neg && (*t)->an[orient] < 0.0) ||
-					( neg && (*t)->an[orient] >= 0.0) ) {
-					navg -= (*t)->an;
+			navg = SmVector3P(0.0);
+			for(t = (*c).second.tfirst; t < tend; t++) {
+				const SmVector3 &an = inputmesh[cubefaces[t]].an;
+				if ( (!neg && an[orient] < 0.0) ||
+					( neg && an[orient] >= 0.0) ) {
+					navg -= an;
+				} else {
+					navg += an;
+				}
+			}
+			for(p = (*c).second.plist.begin(); p != (*c).second.plist.end(); p++) {
+				if ( (!neg && (*p)->n[orient] < 0.0) ||
+					( neg && (*p)->n[orient] >= 0.0) ) {
+					navg -= (*p)->n;
 				} else {
-					navg += (*t)->an;
+					navg += (*p)->n;
 				}
 			}
 		}
@@ -801,16 +1948,25 @@ void compute_cube_normals()
 
 void init_voxels()
 {
-	map<SpCubeKey, SpCube>::iterator c, e;
-	vector<Triangle *>::iterator t;
+	vector<SpCubeTable::iterator> order;
+	vector<SpCubeTable::iterator>::iterator i;
+	SpCubeTable::iterator c;
 	unsigned char orient;
-
-	for(c = cubelist.begin(); c != cubelist.end();) {
-		
+	bool kept = false;
+	int bottom = 0;
+
+	// a cube that finds no voxels is removed, which the neighbor
+	// search of the cubes after it sees, so keep to the sorted order
+	cubelist.sorted(order);
+	for(i = order.begin(); i != order.end(); i++) {
+		c = *i;
 		orient = (*c).second.orientget();
 
+		// the bottom layer is that of the first cube left
+		if(!kept) bottom = (*c).first.loc[1];
+
 		// keep positive direction for base:
-		if(args.OPTS_BASE>0 && orient == 1 && (*c).first.loc[1] < (*cubelist.begin()).first.loc[1] + args.OPTS_BASE);
+		if(args.OPTS_BASE>0 && orient == 1 && (*c).first.loc[1] < bottom + args.OPTS_BASE);
 		// otherwise check to see if direction should be switched.
 		else if((*c).second.avgnormal[orient] < 0.0)
 			(*c).second.orientneg();
@@ -836,10 +1992,7 @@ void init_voxels()
 				// check last time
 				if((*c).second.voxels[orient] == 0) {
 					// delete cube
-					e = c;
-					c++; // can't increment iterator if the element is erased,
-					     // so increment the iterator first.
-					cubelist.erase(e);
+					cubelist.erase(c);
 					continue;
 				}
 			} else {
@@ -851,7 +2004,7 @@ void init_voxels()
 		}
 
 		if(args.OPTS_STUDSUP) (*c).second.orientset(1);
-		c++;
+		kept = true;
 	}
 }
 
@@ -859,13 +2012,13 @@ void voxelize(SpCubeKey loc, SpCube *cubeptr)
 {
 	unsigned char i, j, k;
 	unsigned char d, e, f;
-	vector<Triangle *>::iterator t;
+	unsigned int t, tend = cubeptr->tfirst + cubeptr->tcount;
 
 	VoxelList fill;
 
 	SmVector3 pt, llc;
-	set<Hit> intersections;
-	set<Hit>::iterator s;
+	vector<Hit> intersections;
+	vector<Hit>::iterator s;
 
 	d = cubeptr->orientget();
 	e = (d+1) % 3;
@@ -882,16 +2035,33 @@ void voxelize(SpCubeKey loc, SpCube *cubeptr)
 		for (j = 0; j < SPCUBE_WIDTH / VOXEL_WIDTH; j++) {
 			pt[f] = llc[f] + (2*j+1)*args.OPTS_SCALE*VOXEL_WIDTH/2;
 			intersections.clear();
-			for (t = cubeptr->tlist.begin(); t != cubeptr->tlist.end(); t++) {
-				// check the triangle for intersection
-				if(recordintersect((*t), pt, d, &intersections) && !cubeptr->isthin(d)) break;
+			if(args.OPTS_BVH) {
+				bvhintersect(loc, pt, d, &intersections, cubeptr->isthin(d));
+			} else {
+				for (t = cubeptr->tfirst; t < tend; t++) {
+					// check the triangle for intersection
+					if(recordintersect(cubefaces[t], pt, d, &intersections) && !cubeptr->isthin(d)) break;
+				}
 			}
+			if(intersections.empty() || cubeptr->isthin(d))
+				recordpoints(cubeptr, pt, d, &intersections);
 
 			if(intersections.empty() && !args.OPTS_NOFILL){
-				if(!intersectneighbors(loc, pt, d, &intersections, true))
+				// points are only found cube by cube
+				if(args.OPTS_BVH && inputpoints.empty()) {
+					if(!bvhnearest(loc, pt, d, &intersections, true))
+						bvhnearest(loc, pt, d, &intersections, false);
+				} else if(!intersectneighbors(loc, pt, d, &intersections, true)) {
 					intersectneighbors(loc, pt, d, &intersections, false);
+				}
 			}
 
+			// order the intersections along the ray.  Without exact
+			// ray tests a ray through a shared edge hits each face
+			sort(intersections.begin(), intersections.end());
+			if(!args.OPTS_WATERTIGHT)
+				intersections.erase(unique(intersections.begin(), intersections.end(), samehit), intersections.end());
+
 			// iterate through the list of intersections
 			// compute fill between intersections
 			if(!intersections.empty()) {
@@ -940,29 +2110,113 @@ void voxelize(SpCubeKey loc, SpCube *cubeptr)
 	}
 }
 
-inline bool recordintersect(Triangle *t, SmVector3 &pt, const unsigned char &d, set<Hit> *hitlist)
+void compute_ray_records()
+{
+	size_t i, n = inputmesh.size();
+	unsigned char d;
+	double range = 0.0;
+	int exponent;
+
+	meshrays.resize(3*n);
+	for(d = 0; d < 3; d++)
+		for(i = 0; i < n; i++)
+			meshrays[d*n + i].set(inputmesh[i], d);
+
+	if(!args.OPTS_WATERTIGHT || n == 0)
+		return;
+
+	// the finest power of two grid that holds the mesh and the rays
+	// of the cubes around it, in steps of half a voxel width so that
+	// every ray lies exactly on the grid
+	for(i = 0; i < n; i++) {
+		for(d = 0; d < 3; d++) {
+			range = max<double>(range, fabs(inputmesh[i].mn[d] + args.OPTS_OFFSET[d]));
+			range = max<double>(range, fabs(inputmesh[i].mx[d] + args.OPTS_OFFSET[d]));
+		}
+	}
+	range = range / (args.OPTS_SCALE*VOXEL_WIDTH/2) + 2*SPCUBE_WIDTH/VOXEL_WIDTH;
+	frexp(FIXED_LIMIT / range, &exponent);
+	meshfixscale = ldexp(1.0, exponent - 1) / (args.OPTS_SCALE*VOXEL_WIDTH/2);
+
+	meshfixrays.resize(3*n);
+	for(d = 0; d < 3; d++)
+		for(i = 0; i < n; i++)
+			meshfixrays[d*n + i].set(inputmesh[i], d, args.OPTS_OFFSET, meshfixscale);
+}
+
+inline bool recordintersect(unsigned int face, SmVector3 &pt, const unsigned char &d, vector<Hit> *hitlist)
 {
+	unsigned char e = (d+1) % 3, f = (d+2) % 3;
+	size_t i = d*inputmesh.size() + face;
+	const Triangle *t = &inputmesh[face];
 	Hit hit;
-	if(t->un[d] != 0 && t->intersect(pt,d)) {
-		hit.position = pt[d];
+
+	if(args.OPTS_WATERTIGHT) {
+		if(t->un[d] == 0 || !meshfixrays[i].intersect(
+				(long long) floor((pt[e] + args.OPTS_OFFSET[e])*meshfixscale + 0.5),
+				(long long) floor((pt[f] + args.OPTS_OFFSET[f])*meshfixscale + 0.5)))
+			return false;
+		hit.position = meshrays[i].position(pt[e], pt[f]);
+		hit.inside = meshfixrays[i].inside;
+		hitlist->push_back(hit);
+		return true;
+	}
+
+	// check pt vs bounding box in orthogonal directions
+	if(t->un[d] == 0 || !(pt[e] > t->mn[e] && pt[e] <= t->mx[e] && pt[f] > t->mn[f] && pt[f] <= t->mx[f]))
+		return false;
+
+	if(meshrays[i].intersect(pt[e], pt[f], hit.position)) {
 		hit.inside = (t->un[d] > 0);
-		hitlist->insert(hitlist->begin(),hit);
+		hitlist->push_back(hit);
 		return true;
 	}
 	return false;
 }
 
-bool intersectneighbors(SpCubeKey loc, SmVector3 &pt, const unsigned char d, set<Hit> *hitlist, bool plus)
+bool recordpoints(SpCube *cubeptr, SmVector3 &pt, const unsigned char d, vector<Hit> *hitlist)
 {
-	vector<Triangle *>::iterator t;
-	map<SpCubeKey,SpCube>::iterator c;
+	vector<CloudPoint *>::iterator p;
+	unsigned char e = (d+1) % 3, f = (d+2) % 3;
+	double reach = (VOXEL_WIDTH/2 + SPCUBE_PAD) * args.OPTS_SCALE,
+		position = 0.0, normal = 0.0;
+	unsigned int count = 0;
+	Hit hit;
+
+	for(p = cubeptr->plist.begin(); p != cubeptr->plist.end(); p++) {
+		if(fabs((*p)->p[e] - pt[e]) > reach || fabs((*p)->p[f] - pt[f]) > reach) continue;
+		if(cubeptr->isthin(d)) {
+			hit.position = (*p)->p[d];
+			hit.inside = ((*p)->n[d] > 0);
+			hitlist->push_back(hit);
+		} else {
+			position += (*p)->p[d];
+			normal += (*p)->n[d];
+		}
+		count++;
+	}
+
+	// a single surface: one hit at the average depth
+	if(count && !cubeptr->isthin(d)) {
+		hit.position = position / count;
+		hit.inside = (normal > 0);
+		hitlist->push_back(hit);
+	}
+	return count > 0;
+}
 
-	loc[d] += plus ? 1 : -1;
+bool intersectneighbors(SpCubeKey loc, SmVector3 &pt, const unsigned char d, vector<Hit> *hitlist, bool plus)
+{
+	unsigned int t;
+	SpCube *c;
 
-	if((c = cubelist.find(loc)) != cubelist.end()) {
-		for (t = (*c).second.tlist.begin(); t != (*c).second.tlist.end(); t++) {
-			if(recordintersect((*t), pt, d, hitlist) && !(*c).second.isthin(d)) break;
+	if((c = cubelist.neighbor(loc, plus ? 2*d : 2*d+1))) {
+		loc[d] += plus ? 1 : -1;
+		for (t = c->tfirst; t < c->tfirst + c->tcount; t++) {
+			if(recordintersect(cubefaces[t], pt, d, hitlist) && !c->isthin(d)) break;
 		}
+		if(hitlist->empty() || c->isthin(d))
+			recordpoints(c, pt, d, hitlist);
 		if(hitlist->empty()) {
 			return intersectneighbors(loc, pt, d, hitlist, plus);
 		} else { 
@@ -973,40 +2227,167 @@ bool intersectneighbors(SpCubeKey loc, SmVector3 &pt, const unsigned char d, set
 	}		
 }
 
+void build_bvh()
+{
+	unsigned int i;
+
+	meshbvh.clear();
+	meshbvhfaces.resize(inputmesh.size());
+	for(i = 0; i < meshbvhfaces.size(); i++)
+		meshbvhfaces[i] = i;
+
+	if(!inputmesh.empty()) {
+		meshbvh.reserve(2*(inputmesh.size()/BVH_LEAF + 1));
+		build_bvh_node(0, inputmesh.size());
+	}
+}
+
+void build_bvh_node(unsigned int first, unsigned int last)
+{
+	unsigned int node = meshbvh.size(), i, mid;
+	SmVector3P mn(inputmesh[meshbvhfaces[first]].mn), mx(inputmesh[meshbvhfaces[first]].mx),
+		cmn(mn + mx), cmx(cmn), c;
+	unsigned char axis;
+
+	for(i = first + 1; i < last; i++) {
+		const Triangle &t = inputmesh[meshbvhfaces[i]];
+		mn.minSet(SmVector3P(t.mn));
+		mx.maxSet(SmVector3P(t.mx));
+		c = SmVector3P(t.mn) + SmVector3P(t.mx);
+		cmn.minSet(c);
+		cmx.maxSet(c);
+	}
+
+	meshbvh.push_back(BVHNode());
+	meshbvh[node].mn = mn;
+	meshbvh[node].mx = mx;
+
+	if(last - first <= BVH_LEAF) {
+		meshbvh[node].first = first;
+		meshbvh[node].count = last - first;
+	} else {
+		// split at the median along the longest extent of the centers
+		c = cmx - cmn;
+		axis = (c[0] >= c[1] && c[0] >= c[2]) ? 0 : ((c[1] >= c[2]) ? 1 : 2);
+		mid = first + (last - first)/2;
+		nth_element(meshbvhfaces.begin() + first, meshbvhfaces.begin() + mid,
+			meshbvhfaces.begin() + last, CentroidOrder(inputmesh, axis));
+		build_bvh_node(first, mid);
+		build_bvh_node(mid, last);
+	}
+	meshbvh[node].skip = meshbvh.size();
+}
+
+bool bvhintersect(SpCubeKey loc, SmVector3 &pt, const unsigned char d, vector<Hit> *hitlist, bool all)
+{
+	unsigned char e = (d+1) % 3, f = (d+2) % 3;
+	double half = (SPCUBE_WIDTH/2.0 + SPCUBE_PAD) * args.OPTS_SCALE,
+		// faces of the cube lie within a cube either side of it
+		lo = (loc[d] - 1)*args.OPTS_SCALE*SPCUBE_WIDTH - args.OPTS_OFFSET[d],
+		hi = (loc[d] + 2)*args.OPTS_SCALE*SPCUBE_WIDTH - args.OPTS_OFFSET[d];
+	SmVector3 center = cube_center(loc);
+	size_t mark = hitlist->size();
+	unsigned int i = 0, j, face, best = UINT_MAX;
+	SpCubeKey mn, mx;
+	bool exact;
+
+	while(i < meshbvh.size()) {
+		const BVHNode &node = meshbvh[i];
+		if(pt[e] < node.mn[e] || pt[e] > node.mx[e] || pt[f] < node.mn[f] || pt[f] > node.mx[f] ||
+		   node.mx[d] < lo || node.mn[d] > hi) {
+			i = node.skip;
+			continue;
+		}
+		for(j = node.first; j < node.first + node.count; j++) {
+			face = meshbvhfaces[j];
+			if(!all && face > best) continue;
+
+			// only the faces partition_space put in the cube
+			const Triangle &t = inputmesh[face];
+			exact = face_cubes(t, mn, mx);
+			if(loc[d] < mn[d] || loc[d] >= mx[d] || (exact && !t.overlap(center, half)))
+				continue;
+
+			if(recordintersect(face, pt, d, hitlist) && !all) {
+				// keep the hit of the first face in the cube, like its face list
+				if(best != UINT_MAX) {
+					(*hitlist)[mark] = hitlist->back();
+					hitlist->pop_back();
+				}
+				best = face;
+			}
+		}
+		i++;
+	}
+	return hitlist->size() > mark;
+}
+
+bool bvhnearest(SpCubeKey loc, SmVector3 &pt, const unsigned char d, vector<Hit> *hitlist, bool plus)
+{
+	unsigned char e = (d+1) % 3, f = (d+2) % 3;
+	SmReal limit = (loc[d] + (plus ? 1 : 0))*args.OPTS_SCALE*SPCUBE_WIDTH - args.OPTS_OFFSET[d],
+		best = plus ? HUGE_VAL : -HUGE_VAL;
+	vector<Hit> hits;
+	unsigned int i = 0, j;
+	Hit nearest;
+
+	while(i < meshbvh.size()) {
+		const BVHNode &node = meshbvh[i];
+		if(pt[e] < node.mn[e] || pt[e] > node.mx[e] || pt[f] < node.mn[f] || pt[f] > node.mx[f] ||
+		   (plus ? (node.mx[d] < limit || node.mn[d] > best) : (node.mn[d] > limit || node.mx[d] < best))) {
+			i = node.skip;
+			continue;
+		}
+		for(j = node.first; j < node.first + node.count; j++) {
+			hits.clear();
+			if(!recordintersect(meshbvhfaces[j], pt, d, &hits)) continue;
+			if(plus ? (hits[0].position > limit && hits[0].position < best) :
+			          (hits[0].position < limit && hits[0].position > best)) {
+				best = hits[0].position;
+				nearest = hits[0];
+			}
+		}
+		i++;
+	}
+
+	if(best == HUGE_VAL || best == -HUGE_VAL)
+		return false;
+	hitlist->push_back(nearest);
+	return true;
+}
+
 void identify_neighbors()
 {
-	map<SpCubeKey, SpCube>::iterator c;
-	SpCubeKey p, q;
+	SpCubeTable::iterator c;
 	unsigned char d;
 
 	for(c = cubelist.begin(); c != cubelist.end(); c++) {
-		p = (*c).first;
 		(*c).second.neighborclear();
-		for(d = 0; d < 3; d++) {			
-			p[d] += 1;
-			if(cubelist.find(p) != cubelist.end())
+		for(d = 0; d < 3; d++) {
+			if(cubelist.neighbor((*c).first, 2*d))
 				(*c).second.neighboron(d,true);
-			p[d] -= 2;
-			if(cubelist.find(p) != cubelist.end())
+			if(cubelist.neighbor((*c).first, 2*d+1))
 				(*c).second.neighboron(d,false);
-			p[d] += 1;
 		}
 	}
 }
 
 inline SpCube *get_neighbor(SpCubeKey loc, unsigned char n) {
-	map<SpCubeKey, SpCube>::iterator c;
-	loc[n/2] += (n % 2) ? -1 : 1;
-	return &cubelist[loc];
+	return cubelist.neighbor(loc, n);
 }
 void initialize_energy()
 {
-	map<SpCubeKey, SpCube>::iterator c;
+	vector<SpCubeTable::iterator> order;
+	vector<SpCubeTable::iterator>::iterator o;
+	SpCubeTable::iterator c;
 	SpCube *neighbors[7];
 	unsigned char i;
 
-	// initialize list
-	for (c = cubelist.begin(); c != cubelist.end(); c++) {
+	// initialize list, in the sorted order so that cubes that reduce
+	// the energy equally are optimized in the same order every time
+	cubelist.sorted(order);
+	for (o = order.begin(); o != order.end(); o++) {
+		c = *o;
 		neighbors[0] = &((*c).second);
 		for (i=0; i<6; i++) {
 			neighbors[i+1] = ((*c).second.isneighboron(i)) ? 
@@ -1047,8 +2428,8 @@ unsigned int optimize_voxels()
 		// identify cube nearest neighbors
 		for (n=0; n<6; n++) {
 			if(c->isneighboron(n)) {
+				neighbors[0] = get_neighbor(loc, n);
 				loc[n/2] += (n % 2) ? -1 : 1;
-				neighbors[0] = &cubelist[loc];
 				// get neighbor's neighbors
 				for (i=0; i<6; i++) {
 					neighbors[i+1] = (neighbors[0]->isneighboron(i)) ? 
@@ -1142,7 +2523,10 @@ bool ldraw_grid(ofstream &ldr, char *name)
     ldr << "0 LSculpt grid" << endl;
     ldr << "0 Author: LSculpt" << endl;
     ldr << "0 BFC CERTIFY" << endl;
-    for(map<SpCubeKey,SpCube>::iterator c = cubelist.begin(); c != cubelist.end(); c++) {
+    vector<SpCubeTable::iterator> order;
+    cubelist.sorted(order);
+    for(vector<SpCubeTable::iterator>::iterator o = order.begin(); o != order.end(); o++) {
+      SpCubeTable::iterator c = *o;
       ldr << "1 16 "
         << (*c).first[0]*SPCUBE_WIDTH+SPCUBE_WIDTH/2    << " "
         << -((*c).first[1]*SPCUBE_WIDTH+SPCUBE_WIDTH/2) << " "
@@ -1207,9 +2591,16 @@ bool ldraw_plates(ofstream &ldr, char *name)
   ldr << "0 LSculpt options:" << endl;
   ldr << "0 Up vector: " << ((args.OPTS_UP == UP_Y) ? "Y" : "Z") << endl;
   ldr << "0 Rotation:  " << args.OPTS_ROT << endl;
+  if (args.OPTS_ANGLE != 0.0)
+    ldr << "0 Axis:      " << args.OPTS_AXIS[0] << ", " << args.OPTS_AXIS[1] << ", " << args.OPTS_AXIS[2] << ", " << args.OPTS_ANGLE << endl;
+  if (args.OPTS_STRETCH != SmVector3(1.0, 1.0, 1.0))
+    ldr << "0 Stretch:   " << args.OPTS_STRETCH[0] << ", " << args.OPTS_STRETCH[1] << ", " << args.OPTS_STRETCH[2] << endl;
   ldr << "0 Offset:    " << args.OPTS_OFFSET[0] << ", " << args.OPTS_OFFSET[1] << ", " << args.OPTS_OFFSET[2] << endl;
   ldr << "0 Scaling:   " << 1.0/args.OPTS_SCALE << endl << "0" << endl;
-  for (map<SpCubeKey,SpCube>::iterator c = cubelist.begin(); c != cubelist.end(); c++) {
+  vector<SpCubeTable::iterator> order;
+  cubelist.sorted(order);
+  for (vector<SpCubeTable::iterator>::iterator s = order.begin(); s != order.end(); s++) {
+    SpCubeTable::iterator c = *s;
 
     d = (*c).second.orientget();
     e = (d+1) % 3;
@@ -11,18 +11,39 @@ TEMPLATE = app
 # CONFIG += console
 
 console:DEFINES += LSCULPT_CONSOLE
+
+# Add this to store mesh geometry in single precision
+# CONFIG += float32
+
+float32:DEFINES += LSCULPT_FLOAT32
+
+# Add this to use AVX for the vector math and the mesh kernels
+# CONFIG += avx
+
+avx {
+    win32-msvc*:QMAKE_CXXFLAGS += /arch:AVX
+    else:QMAKE_CXXFLAGS += -mavx
+}
+
+# zlib, for reading gzip compressed meshes
+LIBS += -lz
 # QMAKE_LFLAGS += -static-libgcc
 SOURCES += LSculpt.cpp \
+    LSculpt_input.cpp \
     rply.c \
     obj_parser.cpp
 HEADERS += rply.h \
     LSculpt_functions.h \
     LSculpt_classes.h \
+    LSculpt_input.h \
+    LSculpt_soa.h \
     smVector.h \
+    smVectorSimd.h \
     obj_parser.hpp \
     obj.hpp \
     obj_config.hpp \
-    LSculpt_obj.h
+    LSculpt_obj.h \
+    LSculpt_glb.h
 !console {
     win32 {
         LIBS += -L./ \
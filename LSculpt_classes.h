@@ -29,6 +29,11 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <climits>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
@@ -36,7 +41,9 @@
 #include <cmath>
 #include <QFileInfo>
 #include <QString>
+#include <QThread>
 #include "smVector.h"	// 2D and 3D vector library
+#include "smVectorSimd.h"	// SIMD 3D vectors for the per-triangle loops
 #include "rply.h"		// PLY input library
 
 using namespace std;
@@ -78,6 +85,16 @@ using namespace std;
 #define GRID_PN       "GRIDBOX.DAT"
 #define LDR_PREC      3
 
+// Preprocessed mesh cache for commandline option -m
+// The cache is stored next to the input file as inputfile.lsmesh.
+// Each triangle is a record of MESHCACHE_RECORD doubles: the three
+// vertices, area normal, unit normal, and bounding box min and max.
+// The mesh is cached in the units of the file, before welding and
+// decimation, so that changing the scale or fit still uses the cache
+#define MESHCACHE_EXT     ".lsmesh"
+#define MESHCACHE_MAGIC   "LSMESH03"
+#define MESHCACHE_RECORD  21
+
 //
 // ===== Argument definitions ======
 //
@@ -85,6 +102,7 @@ using namespace std;
 #define FORMAT_PLY 1
 #define FORMAT_STL 2
 #define FORMAT_OBJ 3
+#define FORMAT_GLB 4
 #define MESSAGE_NONE 0
 #define MESSAGE_ERR  1
 #define MESSAGE_ALL  2
@@ -102,23 +120,63 @@ using namespace std;
 #define UNIT_LDU_FT  0.0013125
 #define UNIT_LDU_ST  0.05
 
+// Default vertex welding distance, as a fraction of the voxel height.
+// Welding is off unless asked for, -l 0.01 closes most cracks
+#define WELD_DIST    0.0
+
+// Triangles with less area than this times their longest edge
+// squared are slivers, and are culled before partitioning
+#define SLIVER_RATIO 1e-6
+
+// Normals of point cloud points are fitted to at least this many
+// neighbors, searching from half a voxel height out to a voxel width
+#define POINT_NEIGHBORS 8
+
 // Maximum iterations for optimization
 #define OPTIM_MAX    100000
 
+// Minimum number of faces for each thread of mesh_bounds
+#define BOUNDS_CHUNK 65536
+
+// Minimum number of faces for each thread of partition_space
+#define PARTITION_CHUNK 16384
+
+// Largest coordinate on the fixed point grid of the watertight ray
+// test, small enough that its edge functions fit in 64 bits
+#define FIXED_LIMIT 1073741824.0
+
+// Largest number of faces in a leaf of the bounding volume hierarchy
+#define BVH_LEAF 4
+
+// Largest box of space partitioning cubes kept in a dense array by
+// default, see SpCubeTable::bound.  The box is rounded up to a power
+// of two cubes on each side, and each cube of it takes about 100
+// bytes, whether the mesh reaches it or not
+#define DENSE_LIMIT 262144
+
 struct ArgumentSet {
 	bool          OPTS_CENTER;  // center mesh?
 	unsigned char OPTS_FORMAT;  // input file format
+	bool          OPTS_CACHE;   // read/write a preprocessed mesh cache
 	unsigned char OPTS_MESSAGE; // verbosity
 	bool          OPTS_STUDSUP; // initialize studs-up instead of studs-out
 	bool          OPTS_NOFILL;  // just convert the surface, don't try to fill it
+	bool          OPTS_WATERTIGHT; // exact ray tests on a fixed point grid
+	bool          OPTS_BVH;     // find ray hits with the bounding volume hierarchy
+	bool          OPTS_EXACT;   // bin faces only into the cubes they overlap
+	unsigned int  OPTS_DENSE;   // largest box of cubes to keep in a dense array
 	unsigned char OPTS_BASE;    // bias studs-up at the bottom
 	unsigned char OPTS_UP;      // up vector of input mesh
 	SmVector3     OPTS_OFFSET;  // amount to offset input mesh
 	double        OPTS_FIT;     // size to fit input mesh to
 	double        OPTS_SCALE;   // scale factor for mesh
 	double        OPTS_ROT;     // rotation of mesh
-	double        OPTS_ROT_SIN; // sin of said rotation
-	double        OPTS_ROT_COS; // cos of said rotation
+	SmVector3     OPTS_AXIS;    // axis of the extra rotation of mesh
+	double        OPTS_ANGLE;   // extra rotation about OPTS_AXIS
+	SmVector3     OPTS_STRETCH; // non-uniform scale of mesh
+	double        OPTS_XFORM[3][4]; // transform from file coordinates, see set_transform
+	double        OPTS_WELD;    // vertex welding distance, in voxel heights
+	double        OPTS_DECIMATE; // vertex clustering cell size, in voxel heights
 	int           OPTS_MAXITER; // maximum optimization iterations
 	unsigned char OPTS_PART;    // part to use for output
 	unsigned char OPTS_COLOR;   // color scheme for output
@@ -155,17 +213,28 @@ struct ArgumentSet {
 static const ArgumentSet defaultArgs = {
 	true,        // OPTS_CENTER
 	0,           // OPTS_FORMAT
+	false,       // OPTS_CACHE
 	MESSAGE_ERR, // OPTS_MESSAGE
 	false,       // OPTS_STUDSUP
 	false,       // OPTS_NOFILL
+	false,       // OPTS_WATERTIGHT
+	false,       // OPTS_BVH
+	false,       // OPTS_EXACT
+	DENSE_LIMIT, // OPTS_DENSE
 	0,           // OPTS_BASE
 	UP_Y,        // OPTS_UP
 	SmVector3(0.0, 0.0, 0.0), // OPTS_OFFSET
 	0.0,         // OPTS_FIT
 	1.0,         // OPTS_SCALE
 	0.0,         // OPTS_ROT
-	0.0,         // OPTS_ROT_SIN
-	1.0,         // OPTS_ROT_COS
+	SmVector3(0.0, 1.0, 0.0), // OPTS_AXIS
+	0.0,         // OPTS_ANGLE
+	SmVector3(1.0, 1.0, 1.0), // OPTS_STRETCH
+	{{1.0, 0.0, 0.0, 0.0},
+	 {0.0, 1.0, 0.0, 0.0},
+	 {0.0, 0.0, 1.0, 0.0}},   // OPTS_XFORM
+	WELD_DIST,   // OPTS_WELD
+	0.0,         // OPTS_DECIMATE
 	OPTIM_MAX,   // OPTS_MAXITER
 	0,           // OPTS_PART
 	COLOR_OFF,   // OPTS_COLOR
@@ -202,16 +271,34 @@ static const ArgumentSet defaultArgs = {
 
 // custom types used by classes
 #define VoxelList   unsigned int
-#define SpCubeCoord char
+#define SpCubeCoord short
 #define SpCubeFlags unsigned short
 
+// Largest distance of the mesh from the origin, in cubes.  The
+// coordinates need room past it for SPCUBE_PAD and for the spare
+// cubes around the dense array, see partition_space
+#define SPCUBE_MAX ((1 << (sizeof(SpCubeCoord)*CHAR_BIT-1)) - 4)
+
 class Triangle;		// Polygon object face class: 3 vertices, bounding box, and normal
 class Hit;			// A triangle/ray intersection: distance and boolean inside/outside
+class RayRecord;	// Precomputed test of axis aligned rays against a triangle
+class FixedRayRecord; // The same test, exact on a fixed point grid
 
 class SpCubeKey;	// Location of a space partitioning cube 
 class SpCube;		// A space partitioning cube: face list and various properties
+class SpCubeTable;	// Hash table of the space partitioning cubes by location
 class SpCubeEnergy; // Optimization data: location of a space partitioning cube,
                     // the amount its energy can be reduced, and the best orientation
+struct MeshCacheHeader; // Header of a preprocessed mesh cache file
+struct FaceOrder;	// Sort order of indexed triangles by their vertex indices
+struct PlyState;	// Progress of reading one PLY file
+struct CloudPoint;	// A point of a point cloud, with its normal
+struct MeshPart;	// An extra mesh file in the scene, with its placement
+class MeshLoader;	// Thread loading one mesh file of the scene
+class BoundsWorker;	// Thread computing the normals and bounds of part of the mesh
+class PartitionWorker; // Thread binning part of the mesh into the space partitioning cubes
+class BVHNode;		// Node of the bounding volume hierarchy of the mesh
+struct CentroidOrder; // Sort order of faces by the center of their bounding boxes
 
 // ====== Class Definitions =======
 class Triangle {
@@ -224,10 +311,39 @@ public:
 	SmVector3 computenormal(bool);
 	SmVector3 computenormal() { return computenormal(false); };
 	void	  computebounds(SmVector3 &, SmVector3 &);
-	double    area();
+	SmReal    area();
 	SmVector3 unitnormal() { return (un != SmVector3()) ? un : computenormal(false); };
 	SmVector3 areanormal() { return (an != SmVector3()) ? an : computenormal(true); };
 	bool      intersect(SmVector3 &, unsigned char);
+	bool      overlap(const SmVector3 &, SmReal) const;
+};
+
+class RayRecord {
+public:
+	SmReal edge[3][3], // side of each edge: edge[i][0]*p[j] + edge[i][1]*p[k] + edge[i][2]
+		plane[3];      // position of the hit: plane[0]*p[j] + plane[1]*p[k] + plane[2]
+
+	RayRecord() {}; // left unset until set() is called
+	void set(const Triangle &, unsigned char);
+	bool intersect(SmReal, SmReal, SmReal &) const;
+	SmReal position(SmReal pj, SmReal pk) const { return plane[0]*pj + plane[1]*pk + plane[2]; };
+};
+
+class FixedRayRecord {
+public:
+	long long v[3][2], // vertices on the fixed point grid in the other two
+	                   // axes j and k, in counterclockwise order
+		lo[2], hi[2];  // bounding box of the vertices, empty if the face is edge on
+	bool inside;       // the ray enters the mesh through the face
+
+	FixedRayRecord() {}; // left unset until set() is called
+	void set(const Triangle &, unsigned char, const SmVector3 &, SmReal);
+	bool intersect(long long, long long) const;
+};
+
+struct CloudPoint {
+	SmVector3 p,  // position
+		n;        // unit normal, or zero until it is estimated
 };
 
 class SpCubeKey {
@@ -241,13 +357,17 @@ public:
 	inline bool operator<(const SpCubeKey &) const;
 	inline bool operator==(const SpCubeKey &) const;
 	inline bool operator!=(const SpCubeKey &) const;
+	inline unsigned long long packed() const; // the coordinates in one integer, in sort order
+	inline unsigned long long morton() const; // the bits of the coordinates interleaved, in z-order
 	inline SpCubeCoord &operator[](unsigned char i)       { return loc[i]; };
 	inline SpCubeCoord  operator[](unsigned char i) const { return loc[i]; };
 };
 
 class SpCube {
 public:
-	vector<Triangle *> tlist;  // list of triangles
+	unsigned int tfirst,       // triangles of the cube: tcount entries of
+		tcount;                // cubefaces from tfirst on
+	vector<CloudPoint *> plist; // list of points, for point clouds
 	SmVector3 avgnormal;	   // average normal of triangles
 	VoxelList voxels[3];       // list of Lego piece voxels in each direction
 	SpCubeFlags flags;         // information about contents of the cube
@@ -297,14 +417,233 @@ public:
 	inline bool isthin() { return isthin(orientget()); };
 };
 
+class SpCubeTable {
+public:
+	typedef pair<SpCubeKey, SpCube> value_type;
+
+	class iterator {
+	public:
+		iterator() : table(0), index(0) {};
+		iterator(SpCubeTable *t, size_t i) : table(t), index(i) {};
+		value_type &operator*() const  { return table->item(index); };
+		value_type *operator->() const { return &table->item(index); };
+		iterator &operator++() { index = table->next(index + 1); return *this; };
+		iterator operator++(int) { iterator r = *this; ++(*this); return r; };
+		bool operator==(const iterator &a) const { return index == a.index; };
+		bool operator!=(const iterator &a) const { return index != a.index; };
+		size_t position() const { return index; }; // see added()
+	private:
+		SpCubeTable *table;
+		size_t index;     // position in the order the cubes were added
+		friend class SpCubeTable;
+	};
+
+	// Sort order of iterators by the y-x-z order of SpCubeKey
+	struct KeyOrder {
+		bool operator()(const iterator &a, const iterator &b) const { return (*a).first < (*b).first; };
+	};
+
+	SpCubeTable() : count(0), used(0), dense(false) {};
+
+	iterator begin() { return iterator(this, next(0)); };
+	iterator end()   { return iterator(this, removed.size()); };
+	size_t size() const { return count; };
+	size_t added() const { return removed.size(); }; // cubes ever added, including those erased
+	bool empty() const { return count == 0; };
+	bool isdense() const { return dense; };
+	size_t volume() const { return grid.size(); };
+	void clear();
+
+	// Keep the cubes in a flat array over the box from the first
+	// location up to the second, excluded, if the box holds at most
+	// the passed number of cubes.  Only call it on an empty table,
+	// and only add cubes inside the box.  Return true if the array
+	// is used
+	bool bound(const SpCubeKey &, const SpCubeKey &, size_t);
+
+	// Return the cube at the passed location, or null
+	SpCube *lookup(const SpCubeKey &);
+
+	// Return the neighbor (0-5) of the cube at the passed location,
+	// or null.  In the dense array it is found by an offset from the
+	// cube, without a search
+	SpCube *neighbor(const SpCubeKey &, unsigned char);
+
+	// Return the cube at the passed location, adding an empty one
+	// if there is none.  Cubes never move once they are added
+	iterator insert(const SpCubeKey &);
+	SpCube &operator[](const SpCubeKey &k) { return (*insert(k)).second; };
+
+	// Remove a cube.  Other iterators stay valid
+	void erase(iterator);
+
+	// Fill the passed list with the cubes in the y-x-z order of
+	// SpCubeKey, for the output and the stages whose results
+	// depend on the order the cubes are visited in
+	void sorted(vector<iterator> &);
+
+	// Put the cubes in the z-order of their locations, so that cubes
+	// near in space are near in memory and in the order of iteration,
+	// and drop the erased ones.  The passed list is set to the old
+	// position of each cube, in the new order.  In the dense array
+	// the cubes are already in z-order and only the order of iteration
+	// changes; otherwise they move
+	void reorder(vector<unsigned int> &);
+
+private:
+	deque<value_type> cubes;    // the cubes, in the order they were added
+	vector<bool> removed;       // cubes that were erased, in the order they were added
+	vector<unsigned int> slots; // position in cubes + 1 of each slot of the open
+	                            // addressing table, SLOT_EMPTY or SLOT_REMOVED
+	size_t count, used;         // cubes in the table; slots that are not empty
+
+	bool dense;                 // the cubes are in grid instead of cubes
+	SpCubeKey lo;               // location of the first cube of grid
+	size_t extent[3];           // cubes across grid along each axis
+	size_t mask[3];             // bits of the position in grid for each axis
+	vector<value_type> grid;    // the box of cubes, in z-order
+	vector<bool> occupied;      // cubes of grid that were added and not erased
+	vector<size_t> cells;       // position in grid of the cubes, in the order they were added
+	vector<unsigned int> positions; // position in cells of each cube of grid
+
+	enum { SLOT_EMPTY = 0, SLOT_REMOVED = UINT_MAX };
+	static const size_t NO_CELL = (size_t) -1;
+
+	value_type &item(size_t i) { return dense ? grid[cells[i]] : cubes[i]; };
+	size_t cell(const SpCubeKey &) const;   // position in grid of the passed location, or NO_CELL
+	size_t next(size_t) const;              // first cube from the passed position that is not erased
+	size_t slot(const SpCubeKey &) const;   // slot holding the passed location, or an empty slot
+	size_t home(const SpCubeKey &k) const { return (k.packed() * 0x9E3779B97F4A7C15ULL) >> 32 & (slots.size() - 1); };
+	void rehash(size_t);
+};
+
+struct FaceOrder {
+	const vector<unsigned int> &faces;
+
+	FaceOrder(const vector<unsigned int> &f) : faces(f) {};
+	bool operator()(unsigned int a, unsigned int b) const {
+		const unsigned int *fa = &faces[3*a], *fb = &faces[3*b];
+		if(fa[0] != fb[0]) return fa[0] < fb[0];
+		if(fa[1] != fb[1]) return fa[1] < fb[1];
+		return fa[2] < fb[2];
+	};
+};
+
+struct PlyState {
+	vector<SmVector3> vtxs;    // vertices read so far
+	vector<SmVector3> nrms;    // vertex normals read so far, for point clouds
+	vector<Triangle> *mesh;    // mesh receiving the faces
+	ArgumentSet      *args;    // loading options
+	long first, prev, last;    // vertex indices of the current face or strip
+	long strip_offset;         // start of the current strip in the index list
+	bool bad_vertex;           // an out of bounds vertex was reported
+
+	PlyState(vector<Triangle> *m, ArgumentSet *a) : mesh(m), args(a),
+		first(0), prev(0), last(0), strip_offset(0), bad_vertex(false) {};
+};
+
+struct MeshPart {
+	string    file;      // mesh file name
+	SmVector3 offset;    // position in the scene, in mesh units
+	double    rot;       // rotation about the up axis, in degrees
+	double    scale;     // scale factor
+};
+
+class MeshLoader : public QThread {
+public:
+	vector<Triangle> mesh;  // the loaded triangles
+	vector<CloudPoint> points; // the loaded points, if the file is a point cloud
+	ArgumentSet      args;  // loading options for this file
+	bool             ok;    // the file loaded without errors
+
+	MeshLoader(const char *f, const ArgumentSet &a) : args(a), ok(false), file(f) {};
+protected:
+	void run();
+private:
+	string file;
+};
+
+class BoundsWorker : public QThread {
+public:
+	size_t    first, last;  // range of faces of the input mesh
+	size_t    kept;         // faces left at the start of the range
+	size_t    zero, sliver; // faces culled
+	SmVector3 mn, mx;       // bounding box of the faces left
+
+	BoundsWorker(size_t f, size_t l) : first(f), last(l), kept(0), zero(0), sliver(0) {};
+
+	// Compute the normals and bounding boxes of the range, culling
+	// faces and moving the rest to the start of the range
+	void bounds();
+protected:
+	void run();
+};
+
+class PartitionWorker : public QThread {
+public:
+	size_t               first, last; // range of faces of the input mesh
+	bool                 scattering;  // run() does scatter() instead of bin()
+	vector<SpCubeKey>    keys;   // cubes of the faces of the range, face by face
+	vector<unsigned int> ends;   // end of the cubes of each face in keys
+	vector<unsigned int> cubes;  // position in cubelist of the cube of each key,
+	                             // set by partition_space
+	vector<unsigned int> places; // place of the face among the faces of each cube
+	const vector<unsigned int> *firsts; // first place in cubefaces of the
+	                             // cube at each position
+
+	PartitionWorker(size_t f, size_t l) : first(f), last(l), scattering(false), firsts(0) {};
+
+	// Find the cubes of each face of the range, see partition_space
+	void bin();
+
+	// Write the faces of the range into cubefaces, at the places
+	// partition_space assigned them in each of their cubes
+	void scatter();
+protected:
+	void run();
+};
+
+class BVHNode {
+public:
+	SmVector3    mn, mx; // bounding box of the faces below the node
+	unsigned int skip;   // next node to visit if the node is missed,
+	                     // the one after its last descendant
+	unsigned int first,  // faces of a leaf, in meshbvhfaces
+		count;           // 0 for a node with children
+
+	BVHNode() : skip(0), first(0), count(0) {};
+};
+
+struct CentroidOrder {
+	const vector<Triangle> &mesh;
+	unsigned char axis;
+
+	CentroidOrder(const vector<Triangle> &m, unsigned char a) : mesh(m), axis(a) {};
+	bool operator()(unsigned int a, unsigned int b) const {
+		return mesh[a].mn[axis] + mesh[a].mx[axis] < mesh[b].mn[axis] + mesh[b].mx[axis];
+	};
+};
+
+struct MeshCacheHeader {
+	char               magic[8];   // MESHCACHE_MAGIC, not null terminated
+	unsigned long long hash;       // hash of the source file and loading options
+	unsigned long long ntriangles; // number of triangle records that follow
+};
+
 class Hit {
 public:
-	double position;
+	SmReal position;
 	bool inside;
 	inline bool operator<(const Hit &a) const { return (position < a.position) || (position == a.position && inside && !a.inside); };
 	inline bool operator==(const Hit &a) const { return position == a.position; };
 };
 
+inline bool samehit(const Hit &a, const Hit &b)
+// hits at the same position, on the same side of the surface
+{
+	return !(a < b) && !(b < a);
+}
+
 class SpCubeEnergy {
 public:
 	double reduce;			// the amount the energy can be reduced by
@@ -337,12 +676,13 @@ public:
 //
 inline SmVector3 Triangle::computenormal(bool area)
 {
-	an = cross(v[1] - v[0], v[2] - v[0]);
-	un = an / mag(an);
+	SmVector3P a(v[0]), n = cross(SmVector3P(v[1]) - a, SmVector3P(v[2]) - a);
+	an = n;
+	un = n / mag(n);
 	return area ? an : un;
 }
 
-inline double Triangle::area()
+inline SmReal Triangle::area()
 {
 	if(an == SmVector3()) computenormal();
 	return mag(an);
@@ -352,17 +692,16 @@ inline void Triangle::computebounds(SmVector3 &retmin, SmVector3 &retmax)
 // Return the bounds via the pass by reference minimum and maximum positions
 // Also, store the result in the class members mn, mx
 {
-	mn[0] = min(v[0][0],min(v[1][0],v[2][0]));
-	mn[1] = min(v[0][1],min(v[1][1],v[2][1]));
-	mn[2] = min(v[0][2],min(v[1][2],v[2][2]));
-	mx[0] = max(v[0][0],max(v[1][0],v[2][0]));
-	mx[1] = max(v[0][1],max(v[1][1],v[2][1]));
-	mx[2] = max(v[0][2],max(v[1][2],v[2][2]));
+	SmVector3P a(v[0]), b(v[1]), c(v[2]), lo(c), hi(c);
+	lo.minSet(b).minSet(a);
+	hi.maxSet(b).maxSet(a);
+	mn = lo;
+	mx = hi;
 	retmin = mn;
 	retmax = mx;
 }
 
-inline double whichside(SmVector2 a, SmVector2 b, SmVector2 c)
+inline SmReal whichside(SmVector2 a, SmVector2 b, SmVector2 c)
 // Test which side of line a-b point c is on (in the plane)
 {
 	return a[0]*(b[1] - c[1]) + b[0]*(c[1] - a[1]) + c[0]*(a[1] - b[1]);
@@ -374,7 +713,7 @@ inline bool Triangle::intersect(SmVector3 &pt, unsigned char dir)
 // and move pass by reference "pt" to the point of intersection.
 {
 	unsigned char j, k;
-	double r[3];
+	SmReal r[3];
 	j = (dir+1)%3; k = (dir+2)%3;	
 	
 	// check pt vs bounding box in orthogonal directions:
@@ -400,6 +739,140 @@ inline bool Triangle::intersect(SmVector3 &pt, unsigned char dir)
 	return false;
 }
 
+inline bool Triangle::overlap(const SmVector3 &center, SmReal half) const
+// separating axis test of the triangle against the axis aligned
+// cube of the passed center and half width.  The axes to try are
+// those of the cube, the normal of the triangle and the cross
+// products of the edges of the triangle with the axes of the cube
+{
+	SmVector3 p[3], e[3], n, u;
+	SmReal a, b, c, r;
+	unsigned char i, j;
+
+	for (i = 0; i < 3; i++) p[i] = v[i] - center;
+	for (i = 0; i < 3; i++) e[i] = p[(i+1)%3] - p[i];
+
+	// axes of the cube: the bounding boxes
+	for (i = 0; i < 3; i++) {
+		if (min(p[0][i], min(p[1][i], p[2][i])) > half ||
+			max(p[0][i], max(p[1][i], p[2][i])) < -half) return false;
+	}
+
+	// normal of the triangle
+	n = cross(e[0], e[1]);
+	r = half * (fabs(n[0]) + fabs(n[1]) + fabs(n[2]));
+	if (fabs(dot(n, p[0])) > r) return false;
+
+	// edges crossed with the axes of the cube
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			u = SmVector3();
+			u[j] = 1.0;
+			n = cross(u, e[i]);
+			a = dot(n, p[0]); b = dot(n, p[1]); c = dot(n, p[2]);
+			r = half * (fabs(n[0]) + fabs(n[1]) + fabs(n[2]));
+			if (min(a, min(b, c)) > r || max(a, max(b, c)) < -r) return false;
+		}
+	}
+	return true;
+}
+
+inline void RayRecord::set(const Triangle &t, unsigned char dir)
+// precompute the tests of Triangle::intersect for rays aligned
+// with axis dir: the side tests become linear in the ray position
+{
+	unsigned char i, j, k;
+	j = (dir+1)%3; k = (dir+2)%3;
+
+	for (i = 0; i < 3; i++) {
+		const SmVector3 &a = t.v[i], &b = t.v[(i+1)%3];
+		edge[i][0] = a[k] - b[k];
+		edge[i][1] = b[j] - a[j];
+		edge[i][2] = a[j]*b[k] - b[j]*a[k];
+	}
+
+	// faces parallel to the ray are never hit
+	if (t.un[dir] != 0) {
+		SmReal inv = 1 / t.un[dir];
+		plane[0] = -t.un[j] * inv;
+		plane[1] = -t.un[k] * inv;
+		plane[2] = dot(t.un, t.v[0]) * inv;
+	} else {
+		plane[0] = plane[1] = plane[2] = 0;
+	}
+}
+
+inline bool RayRecord::intersect(SmReal pj, SmReal pk, SmReal &pos) const
+// intersect the ray through pj, pk in the other two axes with the
+// triangle.  If an intersection exists, return true and set pos
+// to its position along the ray.  The bounding box of the triangle
+// is not tested here
+{
+	SmReal r0 = edge[0][0]*pj + edge[0][1]*pk + edge[0][2],
+		r1 = edge[1][0]*pj + edge[1][1]*pk + edge[1][2],
+		r2 = edge[2][0]*pj + edge[2][1]*pk + edge[2][2];
+
+	if ((r0 >= 0 && r1 >= 0 && r2 >= 0) || (r0 <= 0 && r1 <= 0 && r2 <= 0)) {
+		pos = position(pj, pk);
+		return true;
+	}
+	return false;
+}
+
+inline void FixedRayRecord::set(const Triangle &t, unsigned char dir, const SmVector3 &origin, SmReal scale)
+// snap the triangle, seen along axis dir, to the fixed point grid
+// with the passed origin and number of grid steps per unit
+{
+	unsigned char i, j, k;
+	long long area, tmp;
+	j = (dir+1)%3; k = (dir+2)%3;
+
+	for (i = 0; i < 3; i++) {
+		v[i][0] = (long long) floor((t.v[i][j] + origin[j])*scale + 0.5);
+		v[i][1] = (long long) floor((t.v[i][k] + origin[k])*scale + 0.5);
+	}
+
+	// the sign of the area is the sign of the normal along dir
+	area = (v[1][0] - v[0][0])*(v[2][1] - v[0][1]) - (v[1][1] - v[0][1])*(v[2][0] - v[0][0]);
+	inside = (area > 0);
+	if (area < 0) {
+		for (i = 0; i < 2; i++) {
+			tmp = v[1][i]; v[1][i] = v[2][i]; v[2][i] = tmp;
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		lo[i] = min(v[0][i], min(v[1][i], v[2][i]));
+		hi[i] = max(v[0][i], max(v[1][i], v[2][i]));
+	}
+	if (area == 0) {
+		lo[0] = 1; hi[0] = 0;
+	}
+}
+
+inline bool FixedRayRecord::intersect(long long pj, long long pk) const
+// intersect the ray through grid point pj, pk with the triangle.  The
+// edge functions are exact, and a ray through an edge or a vertex
+// hits only one of the faces sharing it: an edge counts for the
+// face on its left only if it points down, or right along the j axis
+{
+	long long dj, dk, e;
+	unsigned char i;
+
+	if (pj < lo[0] || pj > hi[0] || pk < lo[1] || pk > hi[1])
+		return false;
+
+	for (i = 0; i < 3; i++) {
+		const long long *a = v[i], *b = v[(i+1)%3];
+		dj = b[0] - a[0];
+		dk = b[1] - a[1];
+		e = dj*(pk - a[1]) - dk*(pj - a[0]);
+		if (e < 0 || (e == 0 && !(dk < 0 || (dk == 0 && dj > 0))))
+			return false;
+	}
+	return true;
+}
+
 
 //
 // Space partitioning cube location member functions
@@ -419,18 +892,7 @@ inline SpCubeKey &SpCubeKey::operator=(const SpCubeKey &b)
 
 inline bool SpCubeKey::operator<(const SpCubeKey &a) const
 // sort by vertical direction (y) first, then x, then z
-{
-	return (
-		((*this).loc[1] < a.loc[1]) ||
-		(((*this).loc[1] <= a.loc[1]) && 
-			(((*this).loc[0] < a.loc[0]) ||
-			(((*this).loc[0] <= a.loc[0]) &&
-				((*this).loc[2] < a.loc[2])
-				)
-			)
-		)
-	);
-}
+{	return packed() < a.packed();	}
 
 inline bool SpCubeKey::operator==(const SpCubeKey &a) const
 {	return ((*this).loc[0] == a.loc[0]) && 
@@ -442,6 +904,40 @@ inline bool SpCubeKey::operator!=(const SpCubeKey &a) const
 		   
 		   ((*this).loc[2] != a.loc[2]);	}
 
+inline unsigned long long spreadbits(unsigned long long a)
+// move the low 21 bits of a to every third bit
+{
+	a &= 0x1fffff;
+	a = (a | a << 32) & 0x1f00000000ffffULL;
+	a = (a | a << 16) & 0x1f0000ff0000ffULL;
+	a = (a | a << 8)  & 0x100f00f00f00f00fULL;
+	a = (a | a << 4)  & 0x10c30c30c30c30c3ULL;
+	a = (a | a << 2)  & 0x1249249249249249ULL;
+	return a;
+}
+
+inline unsigned long long SpCubeKey::morton() const
+// x, y and z bit by bit, from the bottom, with their sign bits flipped
+{
+	const unsigned long long sign = 1ULL << (CHAR_BIT*sizeof(SpCubeCoord) - 1),
+		mask = (sign << 1) - 1;
+	return spreadbits(((unsigned long long) loc[0] ^ sign) & mask) |
+		spreadbits(((unsigned long long) loc[1] ^ sign) & mask) << 1 |
+		spreadbits(((unsigned long long) loc[2] ^ sign) & mask) << 2;
+}
+
+inline unsigned long long SpCubeKey::packed() const
+// y, x and z side by side, from the top, with their sign bits
+// flipped so that the integers sort like the locations
+{
+	const unsigned int bits = CHAR_BIT*sizeof(SpCubeCoord);
+	const unsigned long long mask = (1ULL << bits) - 1,
+		sign = 1ULL << (bits - 1);
+	return (((unsigned long long) loc[1] ^ sign) & mask) << 2*bits |
+		(((unsigned long long) loc[0] ^ sign) & mask) << bits |
+		(((unsigned long long) loc[2] ^ sign) & mask);
+}
+
 //
 // Space partitioning cube member functions
 //
@@ -558,6 +1054,217 @@ inline bool SpCube::isthin(unsigned char d)
 	}
 	return false;	
 }
+
+//
+// Space partitioning cube table member functions
+//
+inline void SpCubeTable::clear()
+{
+	cubes.clear();
+	removed.clear();
+	slots.clear();
+	grid.clear();
+	occupied.clear();
+	positions.clear();
+	cells.clear();
+	count = used = 0;
+	dense = false;
+}
+
+inline bool SpCubeTable::bound(const SpCubeKey &mn, const SpCubeKey &mx, size_t limit)
+{
+	unsigned char i, bits = 0;
+	size_t size;
+
+	// z-order needs the same power of two on each side
+	for (i = 0; i < 3; i++) {
+		extent[i] = (mx[i] > mn[i]) ? mx[i] - mn[i] : 0;
+		if (extent[i] == 0) return false;
+		while (((size_t) 1 << bits) < extent[i]) bits++;
+	}
+	if (3*bits >= 8*sizeof(size_t) || ((size_t) 1 << 3*bits) > limit)
+		return false;
+	size = (size_t) 1 << 3*bits;
+
+	dense = true;
+	lo = mn;
+	for (i = 0; i < 3; i++)
+		mask[i] = spreadbits(size - 1) << i;
+	grid.resize(size);
+	occupied.assign(size, false);
+	positions.resize(size);
+	return true;
+}
+
+inline size_t SpCubeTable::cell(const SpCubeKey &k) const
+{
+	size_t c = 0, o;
+	unsigned char i;
+
+	for (i = 0; i < 3; i++) {
+		o = (size_t) (k[i] - lo[i]);
+		if (o >= extent[i]) return NO_CELL;
+		c |= spreadbits(o) << i;
+	}
+	return c;
+}
+
+inline size_t SpCubeTable::next(size_t i) const
+{
+	while (i < removed.size() && removed[i]) i++;
+	return i;
+}
+
+inline size_t SpCubeTable::slot(const SpCubeKey &k) const
+// linear probing, past removed slots
+{
+	size_t s = home(k), mask = slots.size() - 1;
+	while (slots[s] != SLOT_EMPTY) {
+		if (slots[s] != SLOT_REMOVED && cubes[slots[s] - 1].first == k)
+			return s;
+		s = (s + 1) & mask;
+	}
+	return s;
+}
+
+inline SpCube *SpCubeTable::lookup(const SpCubeKey &k)
+{
+	size_t s;
+
+	if (dense) {
+		s = cell(k);
+		return (s != NO_CELL && occupied[s]) ? &grid[s].second : 0;
+	}
+	if (slots.empty() || (s = slot(k), slots[s] == SLOT_EMPTY))
+		return 0;
+	return &cubes[slots[s] - 1].second;
+}
+
+inline SpCube *SpCubeTable::neighbor(const SpCubeKey &k, unsigned char n)
+{
+	size_t c, d = n/2;
+	SpCubeKey p = k;
+
+	if (dense) {
+		// step from the cell of the cube, unless it is on the side of
+		// the box, by counting in the bits of the axis alone
+		c = cell(k);
+		if (n % 2) {
+			if (k[d] == lo[d]) return 0;
+			c = (((c & mask[d]) - 1) & mask[d]) | (c & ~mask[d]);
+		} else {
+			if ((size_t) (k[d] - lo[d]) + 1 >= extent[d]) return 0;
+			c = (((c | ~mask[d]) + 1) & mask[d]) | (c & ~mask[d]);
+		}
+		return occupied[c] ? &grid[c].second : 0;
+	}
+	p[d] += (n % 2) ? -1 : 1;
+	return lookup(p);
+}
+
+inline SpCubeTable::iterator SpCubeTable::insert(const SpCubeKey &k)
+{
+	size_t s;
+
+	if (dense) {
+		s = cell(k);
+		if (!occupied[s]) {
+			occupied[s] = true;
+			grid[s].first = k;
+			positions[s] = cells.size();
+			cells.push_back(s);
+			removed.push_back(false);
+			count++;
+		}
+		return iterator(this, positions[s]);
+	}
+
+	// keep at least half of the slots empty
+	if (2*(used + 1) > slots.size())
+		rehash(max((size_t) 1024, 4*count));
+
+	s = slot(k);
+	if (slots[s] != SLOT_EMPTY)
+		return iterator(this, slots[s] - 1);
+
+	cubes.push_back(value_type(k, SpCube()));
+	removed.push_back(false);
+	slots[s] = cubes.size();
+	count++;
+	used++;
+	return iterator(this, cubes.size() - 1);
+}
+
+inline void SpCubeTable::erase(iterator c)
+{
+	if (dense)
+		occupied[cells[c.index]] = false;
+	else
+		slots[slot((*c).first)] = SLOT_REMOVED;
+	removed[c.index] = true;
+	(*c).second = SpCube();  // free its lists
+	count--;
+}
+
+inline void SpCubeTable::rehash(size_t n)
+{
+	size_t size = 1, i, s;
+
+	while (size < n) size <<= 1;
+	slots.assign(size, SLOT_EMPTY);
+	used = count;
+	for (i = 0; i < cubes.size(); i++) {
+		if (removed[i]) continue;
+		s = home(cubes[i].first);
+		while (slots[s] != SLOT_EMPTY) s = (s + 1) & (size - 1);
+		slots[s] = i + 1;
+	}
+}
+
+inline void SpCubeTable::reorder(vector<unsigned int> &previous)
+{
+	vector<pair<unsigned long long, size_t> > order;
+	deque<value_type> moving;
+	size_t i;
+
+	// the live cubes by their cell, which is their z-order
+	// in the dense array, or by their z-order code
+	order.reserve(count);
+	for (i = 0; i < removed.size(); i++) {
+		if (removed[i]) continue;
+		order.push_back(make_pair(dense ? (unsigned long long) cells[i] : cubes[i].first.morton(), i));
+	}
+	sort(order.begin(), order.end());
+
+	previous.resize(order.size());
+	for (i = 0; i < order.size(); i++)
+		previous[i] = order[i].second;
+
+	if (dense) {
+		for (i = 0; i < order.size(); i++) {
+			cells[i] = order[i].first;
+			positions[cells[i]] = i;
+		}
+		cells.resize(order.size());
+	} else {
+		for (i = 0; i < order.size(); i++)
+			moving.push_back(cubes[order[i].second]);
+		cubes.swap(moving);
+	}
+	removed.assign(order.size(), false);
+	if (!dense)
+		rehash(max((size_t) 1024, 4*count));
+}
+
+inline void SpCubeTable::sorted(vector<iterator> &list)
+{
+	list.clear();
+	list.reserve(count);
+	for (iterator c = begin(); c != end(); c++)
+		list.push_back(c);
+	sort(list.begin(), list.end(), KeyOrder());
+}
+
 //
 // Space partitioning cube optimization energy member functions
 //
@@ -44,6 +44,10 @@ void load_options(int argc, char*argv[], char* in, char* out);
 // Set the file format argument based on the input file name's extension
 void setFileFormat(ArgumentSet *localArgs, char *in);
 
+// Return a pointer to the extension of a mesh file name, including
+// the .gz of a compressed file, or null if there is no extension
+char *meshextension(char *in);
+
 // Set an output filename, if there is none
 void setOutFile(ArgumentSet localArgs, char *in, char *out);
 
@@ -59,42 +63,136 @@ void setArgumentSet(ArgumentSet args);
 // Print out the help file
 void usage();
 
-// Rotate a vector about y axis by the amount stored in OPTS_ROT
-inline SmVector3 roty(SmVector3);
+// Set OPTS_XFORM to the passed transform followed by OPTS_ROT about
+// the y axis, OPTS_ANGLE about OPTS_AXIS and OPTS_STRETCH
+void set_transform(ArgumentSet &, const double [3][4]);
+
+// Set a transform to the swap of the up axis in the passed options
+void up_transform(const ArgumentSet &, double [3][4]);
+
+// Set a transform to a rotation by the passed angle, in degrees,
+// about the passed axis
+void rotate_transform(SmVector3, double, double [3][4]);
+
+// Multiply two transforms: the third is the second followed by the first
+void multiply_transform(const double [3][4], const double [3][4], double [3][4]);
+
+// Apply OPTS_XFORM to the faces and the points of the passed lists,
+// starting at the passed positions.  Faces are flipped if the
+// transform mirrors them, and point normals are kept perpendicular
+void transform_mesh(vector<Triangle> &, size_t, vector<CloudPoint> &, size_t, const ArgumentSet &);
+
+// Load triangles from a mesh file into the passed mesh, using the
+// loader for the file format in the passed options, and move them
+// into place with OPTS_XFORM.  Files without faces are loaded into
+// the passed point cloud instead
+bool load_mesh(char *f, vector<Triangle> &, vector<CloudPoint> &, ArgumentSet &);
+
+// Load the input file and the extra meshes in meshparts, each on
+// its own thread, and merge them into the input mesh in order
+bool load_scene(char *f);
 
 // Load triangles from a OBJ file using the libobj library
-bool load_triangles_obj(char *f);
+bool load_triangles_obj(char *f, vector<Triangle> &, ArgumentSet &);
+
+// Load triangles from a binary glTF 2.0 (.glb) file, placing each
+// mesh by the transforms of the nodes that use it
+bool load_triangles_glb(char *f, vector<Triangle> &, ArgumentSet &);
 
-// Load triangles from a ply file using the rPly library
-bool load_triangles_ply(char *f);
+// Load triangles from a ply file using the rPly library.  If the
+// file has vertices but no faces, load them as a point cloud,
+// with their normals if the file has them
+bool load_triangles_ply(char *f, vector<Triangle> &, vector<CloudPoint> &, ArgumentSet &);
 
-// callback function for vertices
+// callback function for vertices, with the PlyState as user data
 int myply_vertex_cb(p_ply_argument argument);
 
-// callback function for faces
+// callback function for faces, with the PlyState as user data
 int myply_face_cb(p_ply_argument argument);
 
 // Load triangles from a binary STL file
-bool load_triangles_stl(char *f);
+bool load_triangles_stl(char *f, vector<Triangle> &);
 
 // Load triangles from an ascii STL file
-bool load_triangles_stla(char *f);
+bool load_triangles_stla(char *f, vector<Triangle> &);
+
+// Hash the contents of the input file together with the options
+// that affect loading, to identify a matching mesh cache
+unsigned long long mesh_cache_hash(char *f);
+
+// Load triangles, normals and bounding boxes from the mesh cache
+// next to the input file.  Returns false if there is no cache
+// or if it was made from a different file or different options
+bool load_mesh_cache(char *f, unsigned long long hash);
+
+// Write the loaded triangles, normals and bounding boxes to
+// the mesh cache next to the input file, before welding and
+// decimation, which depend on the scale
+bool save_mesh_cache(char *f, unsigned long long hash);
+
+// Merge vertices closer than OPTS_WELD voxel heights using a spatial
+// hash, building the indexed mesh in meshvtxs and meshfaces.  Faces
+// that collapse and exact duplicate faces are removed from the input
+// mesh, and the normals and bounding boxes of the rest are recomputed
+void weld_mesh();
+
+// Simplify the mesh by vertex clustering: vertices in the same grid
+// cell, OPTS_DECIMATE voxel heights wide, are merged into their average
+void decimate_mesh();
+
+// Rebuild the input mesh from meshvtxs and meshfaces, removing
+// faces that collapsed or became flat, and exact duplicate faces
+void rebuild_mesh(unsigned int &degenerate, unsigned int &duplicate);
+
+// Hash a grid cell into a power of two sized table
+inline unsigned long cell_hash(const long cell[3], unsigned long mask);
 
 // Compute the normal vectors and bounding box for each face
 // in the input mesh, and return the bounding box of the overall
-// mesh in the pass by reference variables
+// mesh in the pass by reference variables.  Faces with zero area
+// and slivers (see SLIVER_RATIO) are removed from the mesh.  Large
+// meshes are split between threads, see BOUNDS_CHUNK
 bool mesh_bounds(SmVector3 &, SmVector3 &);
 
+// Give each point of the point cloud that has no normal the normal
+// of the plane fitted to its neighbors within a stud, pointing
+// away from the center of the cloud
+void estimate_point_normals();
+
+// Return the unit eigenvector of the smallest eigenvalue of
+// a symmetric 3x3 matrix, using Jacobi rotations
+SmVector3 smallest_eigenvector(double [3][3]);
+
 // Intersect the bounding box of each face with the space
-// partitioning cube grid and update the triangle lists in
-// intersected cubes.  Pad bounding boxes by SPCUBE_PAD to
-// avoid holes in the subsequent voxelization
+// partitioning cube grid and build the triangle lists of the
+// intersected cubes in cubefaces.  Pad bounding boxes by SPCUBE_PAD to
+// avoid holes in the subsequent voxelization.  With OPTS_EXACT,
+// faces whose boxes are more than a cube wide in two or more axes
+// are only added to the padded cubes they overlap, see
+// Triangle::overlap.  Points of a point cloud are added to
+// the point lists the same way.  Large meshes are binned by
+// several threads, see PARTITION_CHUNK and PartitionWorker,
+// and the face lists come out in the same order
 void partition_space();
 
-// Find an average normal vector for the faces in each
-// space partitioning cube
+// Find the cubes reached by the padded bounding box of a face,
+// from the first location up to the second, excluded.  Return
+// true if OPTS_EXACT is set and the face has to be tested against
+// each of them
+inline bool face_cubes(const Triangle &, SpCubeKey &, SpCubeKey &);
+
+// Return the center of the passed cube in mesh coordinates
+inline SmVector3 cube_center(const SpCubeKey &);
+
+// Find an average normal vector for the faces and points
+// in each space partitioning cube
 void compute_cube_normals();
 
+// Compute the ray tests of each triangle of the input mesh along
+// each axis into meshrays, see RayRecord.  With OPTS_WATERTIGHT,
+// also snap the mesh to the fixed point grid into meshfixrays
+void compute_ray_records();
+
 // Initialize the voxelization in each cube using voxelize
 // Orient each cube according to the maximum component of the
 // average normal vector
@@ -106,14 +204,44 @@ void init_voxels();
 // call intersectneighbors
 void voxelize(SpCubeKey, SpCube *);
 
-// Test a triangle against a ray through the passed point in the
-// passed direction.  If it hits, add the intersection to the
-// list and return true
-inline bool recordintersect(Triangle *, SmVector3 &, const unsigned char &, set<Hit> *);
+// Test a triangle of the input mesh, by index, against a ray through
+// the passed point in the passed direction, using its ray record.
+// If it hits, add the intersection to the list and return true
+inline bool recordintersect(unsigned int, SmVector3 &, const unsigned char &, vector<Hit> *);
+
+// Splat the points of a cube that lie within SPCUBE_PAD of the column
+// around a ray through the passed point onto the ray, adding a hit for
+// each, inside if the normal points along the ray.  In cubes that are not
+// thin in the passed direction the points merge into one hit.  Return
+// true if any point was close enough
+bool recordpoints(SpCube *, SmVector3 &, const unsigned char, vector<Hit> *);
 
 // Recursively test neighboring cubes to SpCubeKey in the passed direction until
 // an intersection is found or there are no more neighbors
-bool intersectneighbors(SpCubeKey, SmVector3 &, const unsigned char, set<Hit> *, bool);
+bool intersectneighbors(SpCubeKey, SmVector3 &, const unsigned char, vector<Hit> *, bool);
+
+// Build the bounding volume hierarchy of the input mesh into meshbvh
+void build_bvh();
+
+// Add the node for the passed range of meshbvhfaces to meshbvh,
+// splitting it at the median of the longest axis until the leaves
+// hold at most BVH_LEAF faces
+void build_bvh_node(unsigned int, unsigned int);
+
+// Find the hits of a ray through the passed point in the passed
+// direction with the faces of the passed cube, using meshbvh
+// instead of the face list of the cube.  Unless the last argument
+// is true, only the hit of the first face in the face list is added.
+// The nodes are visited in order, skipping the subtree of each
+// node that is missed, so no stack is needed.  Return true if any
+// hit was added
+bool bvhintersect(SpCubeKey, SmVector3 &, const unsigned char, vector<Hit> *, bool);
+
+// Find the nearest hit of a ray through the passed point in the passed
+// direction past the passed cube, in the positive direction if true,
+// using meshbvh.  Unlike intersectneighbors the search does not stop
+// at the first missing cube.  Return true if a hit was added
+bool bvhnearest(SpCubeKey, SmVector3 &, const unsigned char, vector<Hit> *, bool);
 
 // Update each cube's flags with information about which of that
 // cube's neighbors are still in existance after the voxelization
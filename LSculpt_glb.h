@@ -0,0 +1,352 @@
+/*	LSculpt: Studs-out LEGO Sculpture
+
+	Copyright (C) 2010 Bram Lambrecht <bram@bldesign.org>
+
+	http://lego.bldesign.org/LSculpt/
+
+	This file (LSculpt_glb.h) is part of LSculpt.
+
+	LSculpt is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	LSculpt is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see http://www.gnu.org/licenses/  */
+
+//
+// glTF 2.0 binary (.glb) loading.  Vertex positions and indices are
+// read straight from the binary chunk, and node transforms are applied
+// so that scenes with several meshes are placed correctly.
+//
+
+#ifndef LSCULPT_GLB_H
+#define LSCULPT_GLB_H
+
+#include <cstring>
+#include <vector>
+#include <iostream>
+
+#include <QByteArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+
+#include "LSculpt_classes.h"
+#include "LSculpt_input.h"
+
+// glb container
+#define GLB_MAGIC          0x46546C67  // "glTF"
+#define GLB_VERSION        2
+#define GLB_HEADER         12
+#define GLB_CHUNK_HEADER   8
+#define GLB_CHUNK_JSON     0x4E4F534A  // "JSON"
+#define GLB_CHUNK_BIN      0x004E4942  // "BIN"
+
+// accessor component types
+#define GLB_UNSIGNED_BYTE  5121
+#define GLB_UNSIGNED_SHORT 5123
+#define GLB_UNSIGNED_INT   5125
+#define GLB_FLOAT          5126
+
+// primitive modes
+#define GLB_TRIANGLES      4
+#define GLB_TRIANGLE_STRIP 5
+#define GLB_TRIANGLE_FAN   6
+
+// deepest node hierarchy followed, guards against cyclic files
+#define GLB_MAX_DEPTH      64
+
+class glb_loader
+{
+public:
+  glb_loader() : have_bad_index_err_(false), skipped_primitives_(0) {}
+  bool convert(MeshInput& input, std::vector<Triangle>& mesh, ArgumentSet& args);
+  ArgumentSet* LSculpt_args;
+  std::vector<Triangle>* LSculpt_mesh;
+private:
+  void node_cb(int index, const double* parent, int depth);
+  void mesh_cb(int index, const double* m);
+  void primitive_cb(const QJsonObject& primitive, const double* m);
+  const char* accessor(int index, long& count, int& components, int& component_type, long& stride);
+  SmVector3 vertex(const double* m, const char* p);
+  QJsonObject gltf_;
+  std::vector<char> bin_;
+  bool have_bad_index_err_;
+  long skipped_primitives_;
+};
+
+// Matrices are 4x4, column major, as stored in glTF
+static void glb_multiply(const double* a, const double* b, double* out)
+{
+  for (int c = 0; c < 4; c++)
+    for (int r = 0; r < 4; r++)
+      out[c*4 + r] = a[r]*b[c*4] + a[4 + r]*b[c*4 + 1] + a[8 + r]*b[c*4 + 2] + a[12 + r]*b[c*4 + 3];
+}
+
+static const double glb_identity[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+
+bool glb_loader::convert(MeshInput& input, std::vector<Triangle>& mesh, ArgumentSet& args)
+{
+  unsigned int header[GLB_HEADER/4], chunk[GLB_CHUNK_HEADER/4];
+  std::vector<char> json;
+
+  this->LSculpt_mesh = &mesh;
+  this->LSculpt_args = &args;
+
+  if (input.sgetn((char *) header, GLB_HEADER) != GLB_HEADER ||
+      header[0] != GLB_MAGIC || header[1] != GLB_VERSION) {
+    std::cerr << "ERROR: Invalid or unreadable glTF binary file.\n";
+    return false;
+  }
+
+  // read the JSON chunk and the binary chunk, skip any others
+  while (input.sgetn((char *) chunk, GLB_CHUNK_HEADER) == GLB_CHUNK_HEADER) {
+    std::vector<char> skip;
+    std::vector<char>& dst = (chunk[1] == GLB_CHUNK_JSON && json.empty()) ? json :
+                             (chunk[1] == GLB_CHUNK_BIN && bin_.empty()) ? bin_ : skip;
+    dst.resize(chunk[0]);
+    if (chunk[0] > 0 && input.sgetn(&dst[0], chunk[0]) != (std::streamsize) chunk[0]) {
+      std::cerr << "ERROR: Unexpected end of glTF binary file.\n";
+      return false;
+    }
+  }
+
+  QJsonDocument doc = QJsonDocument::fromJson(QByteArray(json.empty() ? "" : &json[0], (int) json.size()));
+  if (!doc.isObject()) {
+    std::cerr << "ERROR: Invalid JSON in glTF binary file.\n";
+    return false;
+  }
+  gltf_ = doc.object();
+
+  QJsonArray nodes = gltf_.value("nodes").toArray();
+  QJsonArray scenes = gltf_.value("scenes").toArray();
+
+  if (scenes.size() > 0) {
+    // place the nodes of the default scene
+    QJsonArray roots = scenes.at(gltf_.value("scene").toInt(0)).toObject().value("nodes").toArray();
+    for (int i = 0; i < roots.size(); i++)
+      this->node_cb(roots.at(i).toInt(-1), glb_identity, 0);
+  } else if (nodes.size() > 0) {
+    // no scene: place every node that is not a child of another
+    std::vector<bool> child(nodes.size(), false);
+    for (int i = 0; i < nodes.size(); i++) {
+      QJsonArray children = nodes.at(i).toObject().value("children").toArray();
+      for (int j = 0; j < children.size(); j++)
+        if (children.at(j).toInt(-1) >= 0 && children.at(j).toInt(-1) < nodes.size())
+          child[children.at(j).toInt(-1)] = true;
+    }
+    for (int i = 0; i < nodes.size(); i++)
+      if (!child[i]) this->node_cb(i, glb_identity, 0);
+  } else {
+    // no nodes: use the meshes as they are
+    for (int i = 0; i < gltf_.value("meshes").toArray().size(); i++)
+      this->mesh_cb(i, glb_identity);
+  }
+
+  if (skipped_primitives_ > 0 && args.OPTS_MESSAGE)
+    std::cerr << "WARNING: Skipped " << skipped_primitives_ << " glTF primitives that are not triangles.\n";
+
+  return true;
+}
+
+void glb_loader::node_cb(int index, const double* parent, int depth)
+{
+  QJsonArray nodes = gltf_.value("nodes").toArray();
+  double local[16], world[16];
+  int i;
+
+  if (index < 0 || index >= nodes.size() || depth > GLB_MAX_DEPTH)
+    return;
+  QJsonObject node = nodes.at(index).toObject();
+
+  if (node.contains("matrix")) {
+    QJsonArray m = node.value("matrix").toArray();
+    for (i = 0; i < 16; i++) local[i] = m.at(i).toDouble(glb_identity[i]);
+  } else {
+    // translation * rotation * scale, with the rotation as quaternion x, y, z, w
+    QJsonArray t = node.value("translation").toArray();
+    QJsonArray r = node.value("rotation").toArray();
+    QJsonArray s = node.value("scale").toArray();
+    double x = r.at(0).toDouble(0.0), y = r.at(1).toDouble(0.0), z = r.at(2).toDouble(0.0), w = r.at(3).toDouble(1.0);
+    double sx = s.at(0).toDouble(1.0), sy = s.at(1).toDouble(1.0), sz = s.at(2).toDouble(1.0);
+    if (r.size() < 4) { x = y = z = 0.0; w = 1.0; }
+    if (s.size() < 3) { sx = sy = sz = 1.0; }
+
+    local[0]  = (1 - 2*(y*y + z*z))*sx; local[1]  = (2*(x*y + z*w))*sx;     local[2]  = (2*(x*z - y*w))*sx;     local[3]  = 0;
+    local[4]  = (2*(x*y - z*w))*sy;     local[5]  = (1 - 2*(x*x + z*z))*sy; local[6]  = (2*(y*z + x*w))*sy;     local[7]  = 0;
+    local[8]  = (2*(x*z + y*w))*sz;     local[9]  = (2*(y*z - x*w))*sz;     local[10] = (1 - 2*(x*x + y*y))*sz; local[11] = 0;
+    local[12] = (t.size() < 3) ? 0.0 : t.at(0).toDouble(0.0);
+    local[13] = (t.size() < 3) ? 0.0 : t.at(1).toDouble(0.0);
+    local[14] = (t.size() < 3) ? 0.0 : t.at(2).toDouble(0.0);
+    local[15] = 1;
+  }
+  glb_multiply(parent, local, world);
+
+  if (node.contains("mesh"))
+    this->mesh_cb(node.value("mesh").toInt(-1), world);
+
+  QJsonArray children = node.value("children").toArray();
+  for (i = 0; i < children.size(); i++)
+    this->node_cb(children.at(i).toInt(-1), world, depth + 1);
+}
+
+void glb_loader::mesh_cb(int index, const double* m)
+{
+  QJsonArray meshes = gltf_.value("meshes").toArray();
+  if (index < 0 || index >= meshes.size())
+    return;
+  QJsonArray primitives = meshes.at(index).toObject().value("primitives").toArray();
+  for (int i = 0; i < primitives.size(); i++)
+    this->primitive_cb(primitives.at(i).toObject(), m);
+}
+
+void glb_loader::primitive_cb(const QJsonObject& primitive, const double* m)
+{
+  long nvertices, nindices, vstride, istride, i, n, idx[3];
+  int vcomponents, vtype, icomponents, itype;
+  const char *vdata, *idata = NULL;
+  bool flip;
+
+  int mode = primitive.value("mode").toInt(GLB_TRIANGLES);
+  if (mode != GLB_TRIANGLES && mode != GLB_TRIANGLE_STRIP && mode != GLB_TRIANGLE_FAN) {
+    skipped_primitives_++;
+    return;
+  }
+
+  vdata = this->accessor(primitive.value("attributes").toObject().value("POSITION").toInt(-1),
+                         nvertices, vcomponents, vtype, vstride);
+  if (!vdata || vcomponents != 3 || vtype != GLB_FLOAT) {
+    skipped_primitives_++;
+    return;
+  }
+
+  nindices = nvertices;
+  if (primitive.contains("indices")) {
+    idata = this->accessor(primitive.value("indices").toInt(-1), nindices, icomponents, itype, istride);
+    if (!idata || icomponents != 1 ||
+        (itype != GLB_UNSIGNED_BYTE && itype != GLB_UNSIGNED_SHORT && itype != GLB_UNSIGNED_INT)) {
+      skipped_primitives_++;
+      return;
+    }
+  }
+
+  // a mirroring transform reverses the winding of the triangles
+  flip = (m[0]*(m[5]*m[10] - m[9]*m[6]) - m[4]*(m[1]*m[10] - m[9]*m[2]) + m[8]*(m[1]*m[6] - m[5]*m[2])) < 0;
+
+  n = (mode == GLB_TRIANGLES) ? nindices/3 : nindices - 2;
+  for (i = 0; i < n; i++) {
+    long corner[3];
+    switch (mode) {
+      case GLB_TRIANGLE_STRIP:
+        corner[0] = i + (i & 1); corner[1] = i + 1 - (i & 1); corner[2] = i + 2;
+        break;
+      case GLB_TRIANGLE_FAN:
+        corner[0] = 0; corner[1] = i + 1; corner[2] = i + 2;
+        break;
+      default:
+        corner[0] = 3*i; corner[1] = 3*i + 1; corner[2] = 3*i + 2;
+        break;
+    }
+    for (int j = 0; j < 3; j++) {
+      if (!idata) {
+        idx[j] = corner[j];
+      } else {
+        const char *p = idata + corner[j]*istride;
+        switch (itype) {
+          case GLB_UNSIGNED_BYTE:  idx[j] = *(const unsigned char *) p; break;
+          case GLB_UNSIGNED_SHORT: { unsigned short s; memcpy(&s, p, sizeof(s)); idx[j] = s; } break;
+          default:                 { unsigned int u;   memcpy(&u, p, sizeof(u)); idx[j] = u; } break;
+        }
+      }
+    }
+
+    if (idx[0] >= nvertices || idx[1] >= nvertices || idx[2] >= nvertices) {
+      if (!have_bad_index_err_) {
+        have_bad_index_err_ = true;
+        std::cerr << "WARNING: glTF file contains an out of bounds vertex.\n";
+      }
+      continue;
+    }
+    if (idx[0] == idx[1] || idx[1] == idx[2] || idx[2] == idx[0])
+      continue;  // degenerate triangle
+
+    this->LSculpt_mesh->push_back(Triangle());
+    this->LSculpt_mesh->back().v[0] = this->vertex(m, vdata + idx[0]*vstride);
+    this->LSculpt_mesh->back().v[1] = this->vertex(m, vdata + idx[flip ? 2 : 1]*vstride);
+    this->LSculpt_mesh->back().v[2] = this->vertex(m, vdata + idx[flip ? 1 : 2]*vstride);
+  }
+}
+
+const char* glb_loader::accessor(int index, long& count, int& components, int& component_type, long& stride)
+{
+  QJsonArray accessors = gltf_.value("accessors").toArray();
+  QJsonArray views = gltf_.value("bufferViews").toArray();
+  double limit, view_offset, accessor_offset, view_length, view_stride, accessor_count;
+  long offset, length, size;
+
+  if (index < 0 || index >= accessors.size())
+    return NULL;
+  QJsonObject accessor = accessors.at(index).toObject();
+
+  int view_index = accessor.value("bufferView").toInt(-1);
+  if (view_index < 0 || view_index >= views.size())
+    return NULL;  // sparse or zero filled accessors are not supported
+  QJsonObject view = views.at(view_index).toObject();
+  if (view.value("buffer").toInt(0) != 0)
+    return NULL;  // only the glb binary chunk is read, not external buffers
+
+  QString type = accessor.value("type").toString();
+  components = (type == "SCALAR") ? 1 : (type == "VEC2") ? 2 : (type == "VEC3") ? 3 : (type == "VEC4") ? 4 : 0;
+  component_type = accessor.value("componentType").toInt(0);
+  size = (component_type == GLB_UNSIGNED_BYTE) ? 1 : (component_type == GLB_UNSIGNED_SHORT) ? 2 : 4;
+
+  // the numbers come straight from the file, so reject negative ones and
+  // any larger than the binary chunk before they are converted to long
+  limit = (double) bin_.size();
+  view_offset = view.value("byteOffset").toDouble(0);
+  accessor_offset = accessor.value("byteOffset").toDouble(0);
+  view_length = view.value("byteLength").toDouble(0);
+  view_stride = view.value("byteStride").toDouble(0);
+  accessor_count = accessor.value("count").toDouble(0);
+  if (components == 0 || bin_.empty() ||
+      !(view_offset >= 0 && view_offset <= limit) || !(accessor_offset >= 0 && accessor_offset <= limit) ||
+      !(view_length >= 0 && view_length <= limit) || !(view_stride >= 0 && view_stride <= limit) ||
+      !(accessor_count >= 1 && accessor_count <= limit))
+    return NULL;
+  length = (long) view_length;
+  stride = (long) view_stride;
+  count = (long) accessor_count;
+  if (stride == 0) stride = components*size;
+
+  // check that the view lies inside the binary chunk and every element
+  // inside the view, dividing rather than multiplying by the count
+  if ((long) view_offset > (long) bin_.size() - length ||
+      (long) accessor_offset > length - components*size ||
+      count - 1 > (length - (long) accessor_offset - components*size) / stride)
+    return NULL;
+
+  offset = (long) view_offset + (long) accessor_offset;
+  return &bin_[0] + offset;
+}
+
+SmVector3 glb_loader::vertex(const double* m, const char* p)
+{
+  float f[3];
+
+  // glTF is y up like the other loaders; the up axis and the
+  // rotation are applied with the rest of the load transform
+  memcpy(f, p, sizeof(f));
+  return SmVector3(
+      m[0]*f[0] + m[4]*f[1] + m[8]*f[2]  + m[12],
+      m[1]*f[0] + m[5]*f[1] + m[9]*f[2]  + m[13],
+      m[2]*f[0] + m[6]*f[1] + m[10]*f[2] + m[14]);
+}
+
+#endif // LSCULPT_GLB_H
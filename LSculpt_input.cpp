@@ -0,0 +1,177 @@
+/*	LSculpt: Studs-out LEGO Sculpture
+
+	Copyright (C) 2010 Bram Lambrecht <bram@bldesign.org>
+
+	http://lego.bldesign.org/LSculpt/
+
+	This file (LSculpt_input.cpp) is part of LSculpt.
+
+	LSculpt is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	LSculpt is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see http://www.gnu.org/licenses/  */
+
+
+//
+// Buffered input for mesh loaders
+// Comments describing each function are in LSculpt_input.h
+//
+
+#include "LSculpt_input.h"
+
+MeshInput::MeshInput() :
+	fp(0), gz(0), length(0), first(0), ready(0),
+	holding(false), finished(false), error(false), stopping(false), reader(0)
+{
+	for(unsigned int i = 0; i < INPUT_BUFFERS; i++) {
+		buffer[i].resize(INPUT_BUFFERSIZE);
+		filled[i] = 0;
+	}
+	setg(0, 0, 0);
+}
+
+MeshInput::~MeshInput()
+{
+	close();
+}
+
+bool MeshInput::open(const char *fname)
+{
+	unsigned char magic[2], isize[4];
+
+	close();
+	if((fp = fopen(fname, "rb")) == 0)
+		return false;
+
+	if(fread(magic, 1, 2, fp) == 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		// gzip file: the last four bytes hold the uncompressed size
+		if(fseek(fp, -4, SEEK_END) == 0 && fread(isize, 1, 4, fp) == 4)
+			length = (unsigned long long) isize[0] | ((unsigned long long) isize[1] << 8) |
+				((unsigned long long) isize[2] << 16) | ((unsigned long long) isize[3] << 24);
+		fclose(fp);
+		fp = 0;
+
+		if((gz = gzopen(fname, "rb")) == 0)
+			return false;
+		gzbuffer(gz, INPUT_BUFFERSIZE);
+	} else {
+		rewind(fp);
+		// the buffers already batch the reads
+		setvbuf(fp, 0, _IONBF, 0);
+		length = QFileInfo(fname).size();
+	}
+
+	// start filling the buffers while the caller parses
+	first = ready = 0;
+	holding = finished = error = stopping = false;
+	reader = new MeshReader(this);
+	reader->start();
+
+	return true;
+}
+
+void MeshInput::close()
+{
+	if(reader) {
+		lock.lock();
+		stopping = true;
+		notfull.wakeAll();
+		lock.unlock();
+		reader->wait();
+		delete reader;
+		reader = 0;
+	}
+	if(gz) gzclose(gz);
+	if(fp) fclose(fp);
+	gz = 0;
+	fp = 0;
+	length = 0;
+	setg(0, 0, 0);
+}
+
+MeshInput::int_type MeshInput::underflow()
+{
+	size_t n;
+
+	if(gptr() < egptr())
+		return traits_type::to_int_type(*gptr());
+
+	if(!reader)
+		return traits_type::eof();
+
+	lock.lock();
+	// hand the buffer we just finished back to the reader thread
+	if(holding) {
+		first = (first + 1) % INPUT_BUFFERS;
+		ready--;
+		holding = false;
+		notfull.wakeAll();
+	}
+	// and wait for the next one
+	while(ready == 0 && !finished)
+		notempty.wait(&lock);
+	if(ready == 0) {
+		lock.unlock();
+		setg(0, 0, 0);
+		return traits_type::eof();
+	}
+	holding = true;
+	n = filled[first];
+	lock.unlock();
+
+	setg(&buffer[first][0], &buffer[first][0], &buffer[first][0] + n);
+	return traits_type::to_int_type(*gptr());
+}
+
+void MeshInput::readall()
+{
+	unsigned int next;
+	long n;
+	int err;
+
+	for(;;) {
+		lock.lock();
+		while(ready == INPUT_BUFFERS && !stopping)
+			notfull.wait(&lock);
+		if(stopping) {
+			lock.unlock();
+			return;
+		}
+		// the buffer after the ones waiting to be parsed is free
+		next = (first + ready) % INPUT_BUFFERS;
+		lock.unlock();
+
+		if(gz)
+			n = gzread(gz, &buffer[next][0], INPUT_BUFFERSIZE);
+		else
+			n = (long) fread(&buffer[next][0], 1, INPUT_BUFFERSIZE, fp);
+
+		lock.lock();
+		if(n <= 0) {
+			// end of file, or a corrupt file.  A truncated gzip
+			// file reads as the end of the file with an error set
+			error = (n < 0) || (gz && (gzerror(gz, &err), err != Z_OK)) || (fp && ferror(fp));
+			finished = true;
+			notempty.wakeAll();
+			lock.unlock();
+			return;
+		}
+		filled[next] = n;
+		ready++;
+		notempty.wakeAll();
+		lock.unlock();
+	}
+}
+
+size_t MeshInput::plysource(void *buf, size_t size, void *handle)
+{
+	return ((MeshInput *) handle)->sgetn((char *) buf, size);
+}
@@ -0,0 +1,114 @@
+/*	LSculpt: Studs-out LEGO Sculpture
+
+	Copyright (C) 2010 Bram Lambrecht <bram@bldesign.org>
+
+	http://lego.bldesign.org/LSculpt/
+
+	This file (LSculpt_input.h) is part of LSculpt.
+
+	LSculpt is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	LSculpt is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see http://www.gnu.org/licenses/  */
+
+
+//
+// Buffered input for mesh loaders.  Files are read, and gzip
+// compressed files inflated, on a separate thread while the loader
+// parses them, so disk access and parsing overlap.
+//
+
+#ifndef LSCULPT_INPUT_H
+#define LSCULPT_INPUT_H
+
+#include <cstdio>
+#include <streambuf>
+#include <vector>
+#include <QFileInfo>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <zlib.h>
+
+using namespace std;
+
+// Buffers passed from the reader thread to the parser
+#define INPUT_BUFFERS     2
+#define INPUT_BUFFERSIZE  (1 << 20)
+
+class MeshInput;	// Stream buffer over a mesh file, inflating gzip files on the fly
+class MeshReader;	// Thread filling the MeshInput buffers from the file
+
+class MeshInput : public streambuf {
+public:
+	MeshInput();
+	~MeshInput();
+
+	// Open a file and start reading it in the background.  Gzip files
+	// are recognized by their first two bytes, independent of the file name
+	bool open(const char *);
+
+	// Stop reading and close the file
+	void close();
+
+	// Check if the file is gzip compressed
+	bool iscompressed() const { return gz != 0; };
+
+	// Check if reading stopped before the end of the file, on a
+	// corrupt or truncated compressed file or a read error.  The
+	// parser sees this as the end of the file, so loaders have to
+	// check it once they are done
+	bool failed() const { return error; };
+
+	// Size of the uncompressed data.  For gzip files this comes from
+	// the file trailer, which only records the size modulo 2^32
+	unsigned long long size() const { return length; };
+
+	// Source callback for rply, reading from the MeshInput handle
+	static size_t plysource(void *, size_t, void *);
+
+protected:
+	int_type underflow();
+
+private:
+	friend class MeshReader;
+
+	FILE              *fp;        // uncompressed file
+	gzFile             gz;        // compressed file
+	unsigned long long length;    // uncompressed size
+
+	vector<char> buffer[INPUT_BUFFERS];
+	size_t       filled[INPUT_BUFFERS]; // number of bytes in each buffer
+	unsigned int first;     // next buffer to parse
+	unsigned int ready;     // number of filled buffers, including one being parsed
+	bool         holding;   // the parser is reading from buffer "first"
+	bool         finished;  // the reader thread reached the end of the file
+	bool         error;     // the reader thread stopped on a read error
+	bool         stopping;  // the reader thread should quit early
+
+	QMutex         lock;
+	QWaitCondition notfull, notempty;
+	MeshReader    *reader;
+
+	// Body of the reader thread
+	void readall();
+};
+
+class MeshReader : public QThread {
+public:
+	MeshReader(MeshInput *in) : input(in) {};
+protected:
+	void run() { input->readall(); };
+private:
+	MeshInput *input;
+};
+
+#endif // LSCULPT_INPUT_H
@@ -59,7 +59,7 @@ private:
   void face_cb_v_vn(const obj::index_2_tuple_type& v1_vn1, const obj::index_2_tuple_type& v2_vn2, const obj::index_2_tuple_type& v3_vn3);
   void face_cb_v_vt_vn(const obj::index_3_tuple_type& v1_vt1_vn1, const obj::index_3_tuple_type& v2_vt2_vn2, const obj::index_3_tuple_type& v3_vt3_vn3);
   std::ostream* ostream_;
-  std::vector<std::tr1::tuple<obj::float_type, obj::float_type, obj::float_type> > vertices_;  
+  std::vector<SmVector3> vertices_;
 };
 
 void obj_loader::error_cb(const std::string& filename, std::size_t line_number, const std::string& message)
@@ -69,22 +69,7 @@ void obj_loader::error_cb(const std::string& filename, std::size_t line_number,
 
 void obj_loader::vertex_cb(obj::float_type x, obj::float_type y, obj::float_type z)
 {
-  switch (this->LSculpt_args->OPTS_UP) {
-    case UP_Z:
-      vertices_.push_back(std::tr1::tuple<obj::float_type, obj::float_type, obj::float_type >(
-          this->LSculpt_args->OPTS_ROT_COS*x - this->LSculpt_args->OPTS_ROT_SIN*y,
-          z,
-          -this->LSculpt_args->OPTS_ROT_SIN*x - this->LSculpt_args->OPTS_ROT_COS*y
-      ));
-      break;
-    default:
-      vertices_.push_back(std::tr1::tuple<obj::float_type, obj::float_type, obj::float_type >(
-          this->LSculpt_args->OPTS_ROT_COS*x + this->LSculpt_args->OPTS_ROT_SIN*z,
-          y,
-          -this->LSculpt_args->OPTS_ROT_SIN*x + this->LSculpt_args->OPTS_ROT_COS*z
-      ));
-      break;
-  }
+  vertices_.push_back(SmVector3(x, y, z));
 }
 
 void obj_loader::face_cb_v(obj::index_type v1, obj::index_type v2, obj::index_type v3)
@@ -93,9 +78,9 @@ void obj_loader::face_cb_v(obj::index_type v1, obj::index_type v2, obj::index_ty
   this->LSculpt_mesh->push_back(Triangle());
 
   // set the vertices of the triangle
-  this->LSculpt_mesh->back().v[0] = SmVector3(std::tr1::get<0>(vertices_[v1 - 1]),std::tr1::get<1>(vertices_[v1 - 1]),std::tr1::get<2>(vertices_[v1 - 1]));
-  this->LSculpt_mesh->back().v[1] = SmVector3(std::tr1::get<0>(vertices_[v2 - 1]),std::tr1::get<1>(vertices_[v2 - 1]),std::tr1::get<2>(vertices_[v2 - 1]));
-  this->LSculpt_mesh->back().v[2] = SmVector3(std::tr1::get<0>(vertices_[v3 - 1]),std::tr1::get<1>(vertices_[v3 - 1]),std::tr1::get<2>(vertices_[v3 - 1]));
+  this->LSculpt_mesh->back().v[0] = vertices_[v1 - 1];
+  this->LSculpt_mesh->back().v[1] = vertices_[v2 - 1];
+  this->LSculpt_mesh->back().v[2] = vertices_[v3 - 1];
 }
 
 void obj_loader::face_cb_v_vt(const obj::index_2_tuple_type& v1_vt1, const obj::index_2_tuple_type& v2_vt2, const obj::index_2_tuple_type& v3_vt3)
@@ -0,0 +1,268 @@
+/*	LSculpt: Studs-out LEGO Sculpture
+
+	Copyright (C) 2010 Bram Lambrecht <bram@bldesign.org>
+
+	http://lego.bldesign.org/LSculpt/
+
+	This file (LSculpt_soa.h) is part of LSculpt.
+
+	LSculpt is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	LSculpt is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see http://www.gnu.org/licenses/  */
+
+
+//
+// Structure of arrays copy of a block of the input mesh.  mesh_bounds
+// computes the normals, areas and bounding boxes of the faces here,
+// several faces at a time with SIMD, and copies the results to the
+// Triangles.  The block is small enough to stay in the cache.
+//
+
+#ifndef LSCULPT_SOA_H
+#define LSCULPT_SOA_H
+
+#include "LSculpt_classes.h"
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Faces in a block of the structure of arrays store
+#define SOA_BLOCK 128
+
+class TriangleSoA;	// Faces of a mesh with one array per coordinate
+class TriangleView;	// One face of a TriangleSoA, read like a Triangle
+
+class TriangleSoA {
+public:
+	SmReal v[3][3][SOA_BLOCK];  // vertices: v[corner][axis][face]
+	SmReal an[3][SOA_BLOCK],    // area normal
+		un[3][SOA_BLOCK],       // unit normal
+		mn[3][SOA_BLOCK],       // bounding box
+		mx[3][SOA_BLOCK],
+		area[SOA_BLOCK],        // length of the area normal
+		edge[SOA_BLOCK];        // squared length of the longest edge
+	size_t count;               // faces in the block
+
+	// Copy the vertices of up to SOA_BLOCK faces of a mesh,
+	// from the first passed face up to the second
+	void assign(const vector<Triangle> &, size_t, size_t);
+
+	// Compute an, un and area of every face
+	void computenormals();
+
+	// Compute mn, mx and edge of every face
+	void computebounds();
+
+	inline size_t size() const { return count; };
+	inline TriangleView operator[](size_t) const;
+};
+
+class TriangleView {
+public:
+	inline TriangleView(const TriangleSoA &s, size_t i) : soa(s), face(i) {};
+
+	inline SmVector3 vertex(unsigned char j) const { return SmVector3(soa.v[j][0][face], soa.v[j][1][face], soa.v[j][2][face]); };
+	inline SmVector3 areanormal() const { return SmVector3(soa.an[0][face], soa.an[1][face], soa.an[2][face]); };
+	inline SmVector3 unitnormal() const { return SmVector3(soa.un[0][face], soa.un[1][face], soa.un[2][face]); };
+	inline SmVector3 boundsmin() const { return SmVector3(soa.mn[0][face], soa.mn[1][face], soa.mn[2][face]); };
+	inline SmVector3 boundsmax() const { return SmVector3(soa.mx[0][face], soa.mx[1][face], soa.mx[2][face]); };
+	inline SmReal area() const { return soa.area[face]; };
+	inline SmReal longestedge() const { return soa.edge[face]; };
+
+	// Copy the computed normals and bounding box into a Triangle
+	inline void store(Triangle &) const;
+
+private:
+	const TriangleSoA &soa;
+	size_t face;
+};
+
+//
+// Lanes of the kernels: AVX holds four doubles or eight floats,
+// SSE2 two doubles and SSE four floats.  Without any of them
+// the kernels are scalar loops
+//
+#if defined(__AVX__) && defined(LSCULPT_FLOAT32)
+#define SOA_LANES 8
+typedef __m256 SoaLanes;
+inline SoaLanes soaLoad(const SmReal *p) { return _mm256_loadu_ps(p); }
+inline void soaStore(SmReal *p, SoaLanes a) { _mm256_storeu_ps(p, a); }
+inline SoaLanes soaAdd(SoaLanes a, SoaLanes b) { return _mm256_add_ps(a, b); }
+inline SoaLanes soaSub(SoaLanes a, SoaLanes b) { return _mm256_sub_ps(a, b); }
+inline SoaLanes soaMul(SoaLanes a, SoaLanes b) { return _mm256_mul_ps(a, b); }
+inline SoaLanes soaDiv(SoaLanes a, SoaLanes b) { return _mm256_div_ps(a, b); }
+inline SoaLanes soaMin(SoaLanes a, SoaLanes b) { return _mm256_min_ps(a, b); }
+inline SoaLanes soaMax(SoaLanes a, SoaLanes b) { return _mm256_max_ps(a, b); }
+inline SoaLanes soaSqrt(SoaLanes a) { return _mm256_sqrt_ps(a); }
+#elif defined(__AVX__)
+#define SOA_LANES 4
+typedef __m256d SoaLanes;
+inline SoaLanes soaLoad(const SmReal *p) { return _mm256_loadu_pd(p); }
+inline void soaStore(SmReal *p, SoaLanes a) { _mm256_storeu_pd(p, a); }
+inline SoaLanes soaAdd(SoaLanes a, SoaLanes b) { return _mm256_add_pd(a, b); }
+inline SoaLanes soaSub(SoaLanes a, SoaLanes b) { return _mm256_sub_pd(a, b); }
+inline SoaLanes soaMul(SoaLanes a, SoaLanes b) { return _mm256_mul_pd(a, b); }
+inline SoaLanes soaDiv(SoaLanes a, SoaLanes b) { return _mm256_div_pd(a, b); }
+inline SoaLanes soaMin(SoaLanes a, SoaLanes b) { return _mm256_min_pd(a, b); }
+inline SoaLanes soaMax(SoaLanes a, SoaLanes b) { return _mm256_max_pd(a, b); }
+inline SoaLanes soaSqrt(SoaLanes a) { return _mm256_sqrt_pd(a); }
+#elif defined(SM_SIMD_SSE)
+#define SOA_LANES 4
+typedef __m128 SoaLanes;
+inline SoaLanes soaLoad(const SmReal *p) { return _mm_loadu_ps(p); }
+inline void soaStore(SmReal *p, SoaLanes a) { _mm_storeu_ps(p, a); }
+inline SoaLanes soaAdd(SoaLanes a, SoaLanes b) { return _mm_add_ps(a, b); }
+inline SoaLanes soaSub(SoaLanes a, SoaLanes b) { return _mm_sub_ps(a, b); }
+inline SoaLanes soaMul(SoaLanes a, SoaLanes b) { return _mm_mul_ps(a, b); }
+inline SoaLanes soaDiv(SoaLanes a, SoaLanes b) { return _mm_div_ps(a, b); }
+inline SoaLanes soaMin(SoaLanes a, SoaLanes b) { return _mm_min_ps(a, b); }
+inline SoaLanes soaMax(SoaLanes a, SoaLanes b) { return _mm_max_ps(a, b); }
+inline SoaLanes soaSqrt(SoaLanes a) { return _mm_sqrt_ps(a); }
+#elif defined(SM_SIMD_SSE2)
+#define SOA_LANES 2
+typedef __m128d SoaLanes;
+inline SoaLanes soaLoad(const SmReal *p) { return _mm_loadu_pd(p); }
+inline void soaStore(SmReal *p, SoaLanes a) { _mm_storeu_pd(p, a); }
+inline SoaLanes soaAdd(SoaLanes a, SoaLanes b) { return _mm_add_pd(a, b); }
+inline SoaLanes soaSub(SoaLanes a, SoaLanes b) { return _mm_sub_pd(a, b); }
+inline SoaLanes soaMul(SoaLanes a, SoaLanes b) { return _mm_mul_pd(a, b); }
+inline SoaLanes soaDiv(SoaLanes a, SoaLanes b) { return _mm_div_pd(a, b); }
+inline SoaLanes soaMin(SoaLanes a, SoaLanes b) { return _mm_min_pd(a, b); }
+inline SoaLanes soaMax(SoaLanes a, SoaLanes b) { return _mm_max_pd(a, b); }
+inline SoaLanes soaSqrt(SoaLanes a) { return _mm_sqrt_pd(a); }
+#else
+#define SOA_LANES 1
+#endif
+
+//
+// TriangleSoA member functions
+//
+inline void TriangleSoA::assign(const vector<Triangle> &mesh, size_t first, size_t last)
+{
+	size_t i;
+	unsigned char j, k;
+
+	count = std::min((size_t) SOA_BLOCK, last - first);
+	for(i = 0; i < count; i++) {
+		const Triangle &t = mesh[first + i];
+		for(j = 0; j < 3; j++)
+			for(k = 0; k < 3; k++)
+				v[j][k][i] = t.v[j][k];
+	}
+}
+
+inline void TriangleSoA::computenormals()
+{
+	size_t i = 0;
+	unsigned char k;
+	SmReal e1[3], e2[3], m;
+
+	// same operations, in the same order, as Triangle::computenormal
+#if SOA_LANES > 1
+	SoaLanes a1[3], a2[3], c[3], l;
+	for(; i + SOA_LANES <= count; i += SOA_LANES) {
+		for(k = 0; k < 3; k++) {
+			a1[k] = soaSub(soaLoad(&v[1][k][i]), soaLoad(&v[0][k][i]));
+			a2[k] = soaSub(soaLoad(&v[2][k][i]), soaLoad(&v[0][k][i]));
+		}
+		c[0] = soaSub(soaMul(a1[1], a2[2]), soaMul(a2[1], a1[2]));
+		c[1] = soaSub(soaMul(a1[2], a2[0]), soaMul(a2[2], a1[0]));
+		c[2] = soaSub(soaMul(a1[0], a2[1]), soaMul(a2[0], a1[1]));
+		l = soaSqrt(soaAdd(soaAdd(soaMul(c[0], c[0]), soaMul(c[1], c[1])), soaMul(c[2], c[2])));
+		soaStore(&area[i], l);
+		for(k = 0; k < 3; k++) {
+			soaStore(&an[k][i], c[k]);
+			soaStore(&un[k][i], soaDiv(c[k], l));
+		}
+	}
+#endif
+	for(; i < count; i++) {
+		for(k = 0; k < 3; k++) {
+			e1[k] = v[1][k][i] - v[0][k][i];
+			e2[k] = v[2][k][i] - v[0][k][i];
+		}
+		an[0][i] = e1[1] * e2[2] - e2[1] * e1[2];
+		an[1][i] = e1[2] * e2[0] - e2[2] * e1[0];
+		an[2][i] = e1[0] * e2[1] - e2[0] * e1[1];
+		m = sqrt(an[0][i] * an[0][i] + an[1][i] * an[1][i] + an[2][i] * an[2][i]);
+		area[i] = m;
+		for(k = 0; k < 3; k++)
+			un[k][i] = an[k][i] / m;
+	}
+}
+
+inline void TriangleSoA::computebounds()
+{
+	size_t i = 0;
+	unsigned char k;
+	SmReal d[3][3];
+
+	// bounds as in Triangle::computebounds, and the longest edge
+	// as in the sliver test of mesh_bounds
+#if SOA_LANES > 1
+	SoaLanes a, b, c, s[3], t[3];
+	for(; i + SOA_LANES <= count; i += SOA_LANES) {
+		for(k = 0; k < 3; k++) {
+			a = soaLoad(&v[0][k][i]);
+			b = soaLoad(&v[1][k][i]);
+			c = soaLoad(&v[2][k][i]);
+			soaStore(&mn[k][i], soaMin(a, soaMin(b, c)));
+			soaStore(&mx[k][i], soaMax(a, soaMax(b, c)));
+			t[0] = soaSub(b, a);
+			t[1] = soaSub(c, b);
+			t[2] = soaSub(a, c);
+			if(k == 0) {
+				s[0] = soaMul(t[0], t[0]);
+				s[1] = soaMul(t[1], t[1]);
+				s[2] = soaMul(t[2], t[2]);
+			} else {
+				s[0] = soaAdd(s[0], soaMul(t[0], t[0]));
+				s[1] = soaAdd(s[1], soaMul(t[1], t[1]));
+				s[2] = soaAdd(s[2], soaMul(t[2], t[2]));
+			}
+		}
+		soaStore(&edge[i], soaMax(s[0], soaMax(s[1], s[2])));
+	}
+#endif
+	for(; i < count; i++) {
+		for(k = 0; k < 3; k++) {
+			mn[k][i] = std::min(std::min(v[2][k][i], v[1][k][i]), v[0][k][i]);
+			mx[k][i] = std::max(std::max(v[2][k][i], v[1][k][i]), v[0][k][i]);
+			d[0][k] = v[1][k][i] - v[0][k][i];
+			d[1][k] = v[2][k][i] - v[1][k][i];
+			d[2][k] = v[0][k][i] - v[2][k][i];
+		}
+		edge[i] = std::max(d[0][0] * d[0][0] + d[0][1] * d[0][1] + d[0][2] * d[0][2],
+			std::max(d[1][0] * d[1][0] + d[1][1] * d[1][1] + d[1][2] * d[1][2],
+			         d[2][0] * d[2][0] + d[2][1] * d[2][1] + d[2][2] * d[2][2]));
+	}
+}
+
+inline TriangleView TriangleSoA::operator[](size_t i) const
+{
+	return TriangleView(*this, i);
+}
+
+//
+// TriangleView member functions
+//
+inline void TriangleView::store(Triangle &t) const
+{
+	t.an = areanormal();
+	t.un = unitnormal();
+	t.mn = boundsmin();
+	t.mx = boundsmax();
+}
+
+#endif // LSCULPT_SOA_H
@@ -148,9 +148,10 @@ void ArgPanel::switchUnits(int newindex)
     }
 
     if(ui->lengthRadio->isChecked()){
-        double newmax = (double)(2 << (sizeof(SpCubeCoord)*CHAR_BIT)) *
+        // the full width of the cube coordinates, in studs
+        double newmax = 2.0 * SPCUBE_MAX * SPCUBE_WIDTH / VOXEL_WIDTH *
                 ui->unitsCombo->itemData(newindex).toDouble() / UNIT_LDU_ST;
-        ui->scaleDSpin->setDecimals(5 - (int)(log10(newmax)));
+        ui->scaleDSpin->setDecimals(max(0, 5 - (int)(log10(newmax))));
         ui->scaleDSpin->setMaximum(newmax);
     } else {
         ui->scaleDSpin->setDecimals(6);
@@ -197,8 +198,6 @@ ArgumentSet ArgPanel::getArguments(ArgumentSet defaults, char *infile)
 	args.OPTS_STUDSUP = ui->studsUpCheck->isChecked();
 
 	args.OPTS_ROT = ui->rotateDSpin->value();
-	args.OPTS_ROT_SIN = sin(args.OPTS_ROT*PI/180.0);
-	args.OPTS_ROT_COS = cos(args.OPTS_ROT*PI/180.0);
 
 	args.OPTS_MAXITER = (ui->maxDetailRadio->isChecked()) ? 0 : OPTIM_MAX;
 
@@ -215,6 +214,11 @@ ArgumentSet ArgPanel::getArguments(ArgumentSet defaults, char *infile)
 	// TODO: need UI widget to set message output level
 	args.OPTS_MESSAGE = MESSAGE_ERR; //MESSAGE_ALL;
 
+	// Every change of settings re-runs LSculpt on the same mesh, so
+	// a mesh cache skips parsing the file each time.  It writes a file
+	// next to the user's mesh, so it is only used when asked for
+	args.OPTS_CACHE = ui->cacheCheck->isChecked();
+
 	args.OPTS_NOFILL = ui->emptyCheck->isChecked();
 
 	args.OPTS_GRID = ui->showGridCheck->isChecked();
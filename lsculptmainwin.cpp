@@ -273,7 +273,7 @@ void LSculptMainWin::import3DMesh()
 	if (!offerSave())
 		return;
 
-    QString filename = QFileDialog::getOpenFileName(this, "Import 3D mesh", QString(), "3D mesh files (*.ply *.stl *.obj *.PLY *.STL *.OBJ);;All Files (*)");
+    QString filename = QFileDialog::getOpenFileName(this, "Import 3D mesh", QString(), "3D mesh files (*.ply *.stl *.obj *.glb *.PLY *.STL *.OBJ *.GLB *.gz *.GZ);;All Files (*)");
 	if (!filename.isEmpty())
 	{
 		currentFilename = filename;
@@ -177,6 +177,7 @@ typedef t_ply_odriver *p_ply_odriver;
  * obj_info: obj_info items for this file
  * nobj_infos: number of obj_info items in file
  * fp: file pointer associated with ply file
+ * source_cb, source: user supplied input, used instead of fp when set
  * rn: skip extra char after end_header? 
  * buffer: last word/chunck of data read from ply file
  * buffer_first, buffer_last: interval of untouched good data in buffer
@@ -200,6 +201,8 @@ typedef struct t_ply_ {
     char *obj_info;
     long nobj_infos;
     FILE *fp;
+    p_ply_source_cb source_cb;
+    void *source;
     int rn;
     char buffer[BUFFERSIZE];
     size_t buffer_first, buffer_token, buffer_last;
@@ -223,6 +226,7 @@ static t_ply_odriver ply_odriver_ascii;
 static t_ply_odriver ply_odriver_binary;
 static t_ply_odriver ply_odriver_binary_reverse;
 
+static size_t ply_fread(p_ply ply, void *anybuffer, size_t size);
 static int ply_read_word(p_ply ply);
 static int ply_check_word(p_ply ply);
 static void ply_finish_word(p_ply ply, size_t size);
@@ -234,6 +238,12 @@ static int ply_write_chunk(p_ply ply, void *anybuffer, size_t size);
 static int ply_write_chunk_reverse(p_ply ply, void *anybuffer, size_t size);
 static void ply_reverse(void *anydata, size_t size);
 
+/* ----------------------------------------------------------------------
+ * Number parsing
+ * ---------------------------------------------------------------------- */
+static double ply_strtol(const char *str, char **end);
+static double ply_strtod(const char *str, char **end);
+
 /* ----------------------------------------------------------------------
  * String functions
  * ---------------------------------------------------------------------- */
@@ -311,7 +321,7 @@ static int BREFILL(p_ply ply) {
     ply->buffer_last = size;
     ply->buffer_first = ply->buffer_token = 0;
     /* fill remaining with new data */
-    size = fread(ply->buffer+size, 1, BUFFERSIZE-size-1, ply->fp);
+    size = ply_fread(ply, ply->buffer+size, BUFFERSIZE-size-1);
     /* place sentinel so we can use str* functions with buffer */
     ply->buffer[BUFFERSIZE-1] = '\0';
     /* check if read failed */
@@ -381,8 +391,31 @@ p_ply ply_open(const char *name, p_ply_error_cb error_cb,
     return ply;
 }
 
+p_ply ply_open_from_source(p_ply_source_cb source_cb, void *handle,
+        p_ply_error_cb error_cb, long idata, void *pdata) {
+    p_ply ply = ply_alloc();
+    if (error_cb == NULL) error_cb = ply_error_cb;
+    if (!ply) {
+        error_cb(NULL, "Out of memory");
+        return NULL;
+    }
+    ply->idata = idata;
+    ply->pdata = pdata;
+    ply->io_mode = PLY_READ;
+    ply->error_cb = error_cb;
+    if (!ply_type_check()) {
+        error_cb(ply, "Incompatible type system");
+        free(ply);
+        return NULL;
+    }
+    assert(source_cb);
+    ply->source_cb = source_cb;
+    ply->source = handle;
+    return ply;
+}
+
 int ply_read_header(p_ply ply) {
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     if (!ply_read_header_magic(ply)) return 0;
     if (!ply_read_word(ply)) return 0;
     /* parse file format */
@@ -429,7 +462,7 @@ long ply_set_read_cb(p_ply ply, const char *element_name,
 int ply_read(p_ply ply) {
     long i;
     p_ply_argument argument;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     argument = &ply->argument;
     /* for each element type */
     for (i = 0; i < ply->nelements; i++) {
@@ -667,7 +700,7 @@ int ply_write(p_ply ply, double value) {
 
 int ply_close(p_ply ply) {
     long i;
-    assert(ply && ply->fp);
+    assert(ply && (ply->fp || ply->source_cb));
     assert(ply->element || ply->nelements == 0);
     assert(!ply->element || ply->nelements > 0);
     /* write last chunk to file */
@@ -676,7 +709,7 @@ int ply_close(p_ply ply) {
         ply_ferror(ply, "Error closing up");
         return 0;
     }
-    fclose(ply->fp);
+    if (ply->fp) fclose(ply->fp);
     /* free all memory used by handle */
     if (ply->element) {
         for (i = 0; i < ply->nelements; i++) {
@@ -930,12 +963,30 @@ static int ply_check_word(p_ply ply) {
     return 1;
 }
 
+/* length of the run of blanks or non-blanks starting at offset t of the
+ * untouched data, stopping at the end of the data in the buffer */
+#define PLY_BLANK(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+static size_t ply_span_blanks(p_ply ply, size_t t) {
+    const char *s = BFIRST(ply);
+    size_t n = BSIZE(ply);
+    while (t < n && PLY_BLANK(s[t])) t++;
+    return t;
+}
+
+static size_t ply_span_word(p_ply ply, size_t t) {
+    const char *s = BFIRST(ply);
+    size_t n = BSIZE(ply);
+    while (t < n && !PLY_BLANK(s[t])) t++;
+    return t;
+}
+
 static int ply_read_word(p_ply ply) {
     size_t t = 0;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     /* skip leading blanks */
     while (1) {
-        t = strspn(BFIRST(ply), " \n\r\t");
+        t = ply_span_blanks(ply, 0);
         /* check if all buffer was made of blanks */
         if (t >= BSIZE(ply)) {
             if (!BREFILL(ply)) {
@@ -946,7 +997,7 @@ static int ply_read_word(p_ply ply) {
     } 
     BSKIP(ply, t); 
     /* look for a space after the current word */
-    t = strcspn(BFIRST(ply), " \n\r\t");
+    t = ply_span_word(ply, 0);
     /* if we didn't reach the end of the buffer, we are done */
     if (t < BSIZE(ply)) {
         ply_finish_word(ply, t);
@@ -961,7 +1012,7 @@ static int ply_read_word(p_ply ply) {
         /* return 0; */
     }
     /* keep looking from where we left */
-    t += strcspn(BFIRST(ply) + t, " \n\r\t");
+    t = ply_span_word(ply, t);
     /* check if the token is too large for our buffer */
     if (t >= BSIZE(ply)) {
         ply_ferror(ply, "Token too large");
@@ -989,7 +1040,7 @@ static int ply_check_line(p_ply ply) {
 
 static int ply_read_line(p_ply ply) {
     const char *end = NULL;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     /* look for a end of line */
     end = strchr(BFIRST(ply), '\n');
     /* if we didn't reach the end of the buffer, we are done */
@@ -1022,10 +1073,15 @@ static int ply_read_line(p_ply ply) {
     return ply_check_line(ply);
 }
 
+static size_t ply_fread(p_ply ply, void *anybuffer, size_t size) {
+    if (ply->source_cb) return ply->source_cb(anybuffer, size, ply->source);
+    return fread(anybuffer, 1, size, ply->fp);
+}
+
 static int ply_read_chunk(p_ply ply, void *anybuffer, size_t size) {
     char *buffer = (char *) anybuffer;
     size_t i = 0;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     assert(ply->buffer_first <= ply->buffer_last);
     while (i < size) {
         if (ply->buffer_first < ply->buffer_last) {
@@ -1034,7 +1090,7 @@ static int ply_read_chunk(p_ply ply, void *anybuffer, size_t size) {
             i++;
         } else {
             ply->buffer_first = 0;
-            ply->buffer_last = fread(ply->buffer, 1, BUFFERSIZE, ply->fp);
+            ply->buffer_last = ply_fread(ply, ply->buffer, BUFFERSIZE);
             if (ply->buffer_last <= 0) return 0;
         }
     }
@@ -1094,6 +1150,9 @@ static void ply_init(p_ply ply) {
     ply->nobj_infos = 0;
     ply->idriver = NULL;
     ply->odriver = NULL;
+    ply->fp = NULL;
+    ply->source_cb = NULL;
+    ply->source = NULL;
     ply->buffer[0] = '\0';
     ply->buffer_first = ply->buffer_last = ply->buffer_token = 0;
     ply->welement = 0;
@@ -1169,7 +1228,7 @@ static p_ply_property ply_grow_property(p_ply ply, p_ply_element element) {
 }
 
 static int ply_read_header_format(p_ply ply) {
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     if (strcmp(BWORD(ply), "format")) return 0;
     if (!ply_read_word(ply)) return 0;
     ply->storage_mode = ply_find_string(BWORD(ply), ply_storage_mode_list);
@@ -1185,7 +1244,7 @@ static int ply_read_header_format(p_ply ply) {
 }
 
 static int ply_read_header_comment(p_ply ply) {
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     if (strcmp(BWORD(ply), "comment")) return 0;
     if (!ply_read_line(ply)) return 0;
     if (!ply_add_comment(ply, BLINE(ply))) return 0;
@@ -1194,7 +1253,7 @@ static int ply_read_header_comment(p_ply ply) {
 }
 
 static int ply_read_header_obj_info(p_ply ply) {
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     if (strcmp(BWORD(ply), "obj_info")) return 0;
     if (!ply_read_line(ply)) return 0;
     if (!ply_add_obj_info(ply, BLINE(ply))) return 0;
@@ -1233,7 +1292,7 @@ static int ply_read_header_property(p_ply ply) {
 static int ply_read_header_element(p_ply ply) {
     p_ply_element element = NULL;
     long dummy;
-    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    assert(ply && (ply->fp || ply->source_cb) && ply->io_mode == PLY_READ);
     if (strcmp(BWORD(ply), "element")) return 0;
     /* allocate room for new element */
     element = ply_grow_element(ply);
@@ -1389,10 +1448,84 @@ static int obinary_float64(p_ply ply, double value) {
 /* ----------------------------------------------------------------------
  * Input  handlers
  * ---------------------------------------------------------------------- */
+/* ----------------------------------------------------------------------
+ * Locale independent replacements for strtol and strtod. ASCII PLY files
+ * always use '.' as decimal point, and these are much faster than the
+ * C library versions, which dominate the time spent reading ASCII files
+ * ---------------------------------------------------------------------- */
+static const double ply_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define PLY_MANTISSA_MAX 100000000000000000ULL
+
+static double ply_strtol(const char *str, char **end) {
+    const char *s = str;
+    unsigned long long n = 0;
+    int negative = 0;
+    if (*s == '-' || *s == '+') negative = (*s++ == '-');
+    if (*s < '0' || *s > '9') {
+        *end = (char *) str;
+        return 0.0;
+    }
+    /* saturate, so that callers' range checks reject huge values */
+    for (; *s >= '0' && *s <= '9'; s++) 
+        if (n < PLY_MANTISSA_MAX) n = 10*n + (*s - '0');
+    *end = (char *) s;
+    return negative ? -(double) n : (double) n;
+}
+
+static double ply_strtod(const char *str, char **end) {
+    const char *s = str, *t;
+    unsigned long long mantissa = 0;
+    int negative = 0, ndigits = 0, exponent = 0, e = 0, eneg = 0;
+    double value;
+    if (*s == '-' || *s == '+') negative = (*s++ == '-');
+    /* keep 17 significant digits, more than a double holds */
+    for (; *s >= '0' && *s <= '9'; s++, ndigits++) {
+        if (mantissa < PLY_MANTISSA_MAX) mantissa = 10*mantissa + (*s - '0');
+        else exponent++;
+    }
+    if (*s == '.') {
+        for (s++; *s >= '0' && *s <= '9'; s++, ndigits++) {
+            if (mantissa < PLY_MANTISSA_MAX) {
+                mantissa = 10*mantissa + (*s - '0');
+                exponent--;
+            }
+        }
+    }
+    /* inf, nan and the like are rare enough to leave to strtod */
+    if (ndigits == 0) return strtod(str, end);
+    if (*s == 'e' || *s == 'E') {
+        t = s + 1;
+        if (*t == '-' || *t == '+') eneg = (*t++ == '-');
+        if (*t >= '0' && *t <= '9') {
+            for (; *t >= '0' && *t <= '9'; t++) 
+                if (e < 10000) e = 10*e + (*t - '0');
+            exponent += eneg ? -e : e;
+            s = t;
+        }
+    }
+    *end = (char *) s;
+    /* exact for up to 15 digits and exponents up to 22 */
+    value = (double) mantissa;
+    if (value != 0.0) {
+        if (exponent < 0) {
+            for (; exponent < -22 && value != 0.0; exponent += 22) value /= 1e22;
+            if (exponent >= -22) value /= ply_pow10[-exponent];
+        } else {
+            for (; exponent > 22 && value <= DBL_MAX; exponent -= 22) value *= 1e22;
+            if (exponent <= 22) value *= ply_pow10[exponent];
+        }
+    }
+    return negative ? -value : value;
+}
+
 static int iascii_int8(p_ply ply, double *value) {
     char *end;
     if (!ply_read_word(ply)) return 0;
-    *value = strtol(BWORD(ply), &end, 10);
+    *value = ply_strtol(BWORD(ply), &end);
     if (*end || *value > PLY_INT8_MAX || *value < PLY_INT8_MIN) return 0;
     return 1;
 }
@@ -1400,7 +1533,7 @@ static int iascii_int8(p_ply ply, double *value) {
 static int iascii_uint8(p_ply ply, double *value) {
     char *end;
     if (!ply_read_word(ply)) return 0;
-    *value = strtol(BWORD(ply), &end, 10);
+    *value = ply_strtol(BWORD(ply), &end);
     if (*end || *value > PLY_UINT8_MAX || *value < 0) return 0;
     return 1;
 }
@@ -1408,7 +1541,7 @@ static int iascii_uint8(p_ply ply, double *value) {
 static int iascii_int16(p_ply ply, double *value) {
     char *end;
     if (!ply_read_word(ply)) return 0;
-    *value = strtol(BWORD(ply), &end, 10);
+    *value = ply_strtol(BWORD(ply), &end);
     if (*end || *value > PLY_INT16_MAX || *value < PLY_INT16_MIN) return 0;
     return 1;
 }
@@ -1416,7 +1549,7 @@ static int iascii_int16(p_ply ply, double *value) {
 static int iascii_uint16(p_ply ply, double *value) {
     char *end;
     if (!ply_read_word(ply)) return 0;
-    *value = strtol(BWORD(ply), &end, 10);
+    *value = ply_strtol(BWORD(ply), &end);
     if (*end || *value > PLY_UINT16_MAX || *value < 0) return 0;
     return 1;
 }
@@ -1424,7 +1557,7 @@ static int iascii_uint16(p_ply ply, double *value) {
 static int iascii_int32(p_ply ply, double *value) {
     char *end;
     if (!ply_read_word(ply)) return 0;
-    *value = strtol(BWORD(ply), &end, 10);
+    *value = ply_strtol(BWORD(ply), &end);
     if (*end || *value > PLY_INT32_MAX || *value < PLY_INT32_MIN) return 0;
     return 1;
 }
@@ -1432,7 +1565,7 @@ static int iascii_int32(p_ply ply, double *value) {
 static int iascii_uint32(p_ply ply, double *value) {
     char *end;
     if (!ply_read_word(ply)) return 0;
-    *value = strtol(BWORD(ply), &end, 10);
+    *value = ply_strtol(BWORD(ply), &end);
     if (*end || *value > PLY_UINT32_MAX || *value < 0) return 0;
     return 1;
 }
@@ -1440,7 +1573,7 @@ static int iascii_uint32(p_ply ply, double *value) {
 static int iascii_float32(p_ply ply, double *value) {
     char *end;
     if (!ply_read_word(ply)) return 0;
-    *value = strtod(BWORD(ply), &end);
+    *value = ply_strtod(BWORD(ply), &end);
     if (*end || *value < -FLT_MAX || *value > FLT_MAX) return 0;
     return 1;
 }
@@ -1448,7 +1581,7 @@ static int iascii_float32(p_ply ply, double *value) {
 static int iascii_float64(p_ply ply, double *value) {
     char *end;
     if (!ply_read_word(ply)) return 0;
-    *value = strtod(BWORD(ply), &end);
+    *value = ply_strtod(BWORD(ply), &end);
     if (*end || *value < -DBL_MAX || *value > DBL_MAX) return 0;
     return 1;
 }
@@ -9,6 +9,8 @@
  * at the end of this file.
  * ---------------------------------------------------------------------- */
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -71,6 +73,31 @@ int ply_get_ply_user_data(p_ply ply, void **pdata, long *idata);
 p_ply ply_open(const char *name, p_ply_error_cb error_cb, long idata, 
         void *pdata);
 
+/* ----------------------------------------------------------------------
+ * Input source callback prototype
+ *
+ * buffer: receives the data read
+ * size: maximum number of bytes to read
+ * handle: source handle passed to ply_open_from_source
+ *
+ * Returns the number of bytes read, 0 at the end of the input
+ * ---------------------------------------------------------------------- */
+typedef size_t (*p_ply_source_cb)(void *buffer, size_t size, void *handle);
+
+/* ----------------------------------------------------------------------
+ * Opens a PLY stream for reading from a user supplied source, such
+ * as a decompressing reader (fails if source is not a PLY file)
+ *
+ * source_cb: function called to read more data
+ * handle: source handle passed to source_cb
+ * error_cb: error callback function
+ * idata,pdata: contextual information available to users
+ *
+ * Returns 1 if successful, 0 otherwise
+ * ---------------------------------------------------------------------- */
+p_ply ply_open_from_source(p_ply_source_cb source_cb, void *handle,
+        p_ply_error_cb error_cb, long idata, void *pdata);
+
 /* ----------------------------------------------------------------------
  * Reads and parses the header of a PLY file returned by ply_open
  *
@@ -44,7 +44,7 @@
 // Added class SmVector2
 //
 // Revision 2.5  1997/10/03  01:04:15  obrienj
-// Added operator*(double,SmVector3)
+// Added operator*(SmReal,SmVector3)
 //
 // Revision 2.4  1997/09/11  20:14:43  obrienj
 // Vector normalize check for div by zero.
@@ -79,6 +79,17 @@ class SmVector3;
 #include <cstdlib>
 #include <iostream>
 
+//-------------------------------------------------------------------
+// Precision of the vector components.  Building with LSCULPT_FLOAT32
+// stores all geometry in single precision, which halves the size of
+// triangles and cubes.
+
+#ifdef LSCULPT_FLOAT32
+typedef float  SmReal;
+#else
+typedef double SmReal;
+#endif
+
 //-------------------------------------------------------------------
 //-------------------------------------------------------------------
 
@@ -91,37 +102,37 @@ public:
   // Constructors
 
   inline SmVector3();
-  inline SmVector3(double d);
-  inline SmVector3(double d0,double d1,double d2);
+  inline SmVector3(SmReal d);
+  inline SmVector3(SmReal d0,SmReal d1,SmReal d2);
 
   inline SmVector3(const SmVector3 &da);
-  inline SmVector3(const double    *da);  
-  // da should point to a double[3] that will be copied
+  inline SmVector3(const SmReal    *da);  
+  // da should point to a SmReal[3] that will be copied
 
 
   //----------------------------------------------
   // Index operators
 
-  inline double &operator[](unsigned int i)      ;
-  inline double  operator[](unsigned int i) const;
+  inline SmReal &operator[](unsigned int i)      ;
+  inline SmReal  operator[](unsigned int i) const;
 
-  inline double &operator()(unsigned int i)      ;
-  inline double  operator()(unsigned int i) const;
+  inline SmReal &operator()(unsigned int i)      ;
+  inline SmReal  operator()(unsigned int i) const;
 
 
   //----------------------------------------------
   // Assignment and set
 
-  inline SmVector3 &set(double d);
-  inline SmVector3 &set(double d0, double d1, double d2);
+  inline SmVector3 &set(SmReal d);
+  inline SmVector3 &set(SmReal d0, SmReal d1, SmReal d2);
 
   inline SmVector3 &set(const SmVector3 &da);
-  inline SmVector3 &set(const double    *da);  
-  // da should point to a double[3] that will be copied
+  inline SmVector3 &set(const SmReal    *da);  
+  // da should point to a SmReal[3] that will be copied
 
-  inline SmVector3 &operator=(double d);
+  inline SmVector3 &operator=(SmReal d);
   inline SmVector3 &operator=(const SmVector3 &da);
-  inline SmVector3 &operator=(const double    *da);  
+  inline SmVector3 &operator=(const SmReal    *da);  
   
 
   //----------------------------------------------
@@ -130,17 +141,17 @@ public:
   inline int operator==(const SmVector3 &da) const;
   inline int operator!=(const SmVector3 &da) const;
 
-  inline int operator==(double d) const;
-  inline int operator!=(double d) const;
+  inline int operator==(SmReal d) const;
+  inline int operator!=(SmReal d) const;
 
 
   //----------------------------------------------
   // In place arithmetic
 
-  inline SmVector3 &operator+=(double d);
-  inline SmVector3 &operator-=(double d);
-  inline SmVector3 &operator*=(double d);
-  inline SmVector3 &operator/=(double d);
+  inline SmVector3 &operator+=(SmReal d);
+  inline SmVector3 &operator-=(SmReal d);
+  inline SmVector3 &operator*=(SmReal d);
+  inline SmVector3 &operator/=(SmReal d);
 
   inline SmVector3 &operator+=(const SmVector3 &da);
   inline SmVector3 &operator-=(const SmVector3 &da);
@@ -169,7 +180,7 @@ public:
   //----------------------------------------------
   // Public data members
 
-  double data[3];
+  SmReal data[3];
 
   //----------------------------------------------
 };
@@ -186,15 +197,15 @@ inline SmVector3 operator-(const SmVector3 &a,const SmVector3 &b);
 inline SmVector3 operator*(const SmVector3 &a,const SmVector3 &b);
 inline SmVector3 operator/(const SmVector3 &a,const SmVector3 &b);
 
-inline SmVector3 operator+(const SmVector3 &a, double b);
-inline SmVector3 operator-(const SmVector3 &a, double b);
-inline SmVector3 operator*(const SmVector3 &a, double b);
-inline SmVector3 operator/(const SmVector3 &a, double b);
+inline SmVector3 operator+(const SmVector3 &a, SmReal b);
+inline SmVector3 operator-(const SmVector3 &a, SmReal b);
+inline SmVector3 operator*(const SmVector3 &a, SmReal b);
+inline SmVector3 operator/(const SmVector3 &a, SmReal b);
 
-inline SmVector3 operator+(double a, const SmVector3 &b);
-inline SmVector3 operator-(double a, const SmVector3 &b);
-inline SmVector3 operator*(double a, const SmVector3 &b);
-inline SmVector3 operator/(double a, const SmVector3 &b);
+inline SmVector3 operator+(SmReal a, const SmVector3 &b);
+inline SmVector3 operator-(SmReal a, const SmVector3 &b);
+inline SmVector3 operator*(SmReal a, const SmVector3 &b);
+inline SmVector3 operator/(SmReal a, const SmVector3 &b);
 
 std::istream &operator>>(std::istream &strm,      SmVector3 &v);
 std::ostream &operator<<(std::ostream &strm,const SmVector3 &v);
@@ -202,13 +213,13 @@ std::ostream &operator<<(std::ostream &strm,const SmVector3 &v);
 //-------------------------------------------------------------------
 // Norm type functions for SmVector3
 
-inline double   l1Norm(const SmVector3 &a);
-inline double   l2Norm(const SmVector3 &a);
-inline double lInfNorm(const SmVector3 &a);
+inline SmReal   l1Norm(const SmVector3 &a);
+inline SmReal   l2Norm(const SmVector3 &a);
+inline SmReal lInfNorm(const SmVector3 &a);
 // Computes the l1, l2 or lInfinity norm of a
 
-inline double    mag(const SmVector3 &a);
-inline double sqrMag(const SmVector3 &a);
+inline SmReal    mag(const SmVector3 &a);
+inline SmReal sqrMag(const SmVector3 &a);
 // mag is the l2Norm or magnitude of the vector
 // sqrMag is mag^2, which is faster to compute
 
@@ -228,21 +239,21 @@ inline unsigned int midinantAxis(const SmVector3 &v);
 // If multiple comonents have the same value, then the
 // results are not unique.
 
-inline double      dot(const SmVector3 &a,const SmVector3 &b);
+inline SmReal      dot(const SmVector3 &a,const SmVector3 &b);
 inline SmVector3 cross(const SmVector3 &a,const SmVector3 &b);
 // Compute the dot and cros product of a and b.
 
-inline double box(const SmVector3 &a,const SmVector3 &b,const SmVector3 &c);
+inline SmReal box(const SmVector3 &a,const SmVector3 &b,const SmVector3 &c);
 // Compute the box (aka tripple) product of a, b, and d.
 
 inline SmVector3 abs(const SmVector3 &a);
 // returns a vector with r[i] = abs(a[i])
 
-inline double sum(const SmVector3 &a);
+inline SmReal sum(const SmVector3 &a);
 // return a[0]+a[1]+a[2]
 
-inline double max(const SmVector3 &a);
-inline double min(const SmVector3 &a);
+inline SmReal max(const SmVector3 &a);
+inline SmReal min(const SmVector3 &a);
 // Returns the max or min component of a.
 
 inline SmVector3 max(const SmVector3 &a,const SmVector3 &b);
@@ -265,37 +276,37 @@ public:
   // Constructors
 
   inline SmVector2();
-  inline SmVector2(double d);
-  inline SmVector2(double d0,double d1);
+  inline SmVector2(SmReal d);
+  inline SmVector2(SmReal d0,SmReal d1);
 
   inline SmVector2(const SmVector2 &da);
-  inline SmVector2(const double    *da);  
-  // da should point to a double[2] that will be copied
+  inline SmVector2(const SmReal    *da);  
+  // da should point to a SmReal[2] that will be copied
 
 
   //----------------------------------------------
   // Index operators
 
-  inline double &operator[](unsigned int i)      ;
-  inline double  operator[](unsigned int i) const;
+  inline SmReal &operator[](unsigned int i)      ;
+  inline SmReal  operator[](unsigned int i) const;
 
-  inline double &operator()(unsigned int i)      ;
-  inline double  operator()(unsigned int i) const;
+  inline SmReal &operator()(unsigned int i)      ;
+  inline SmReal  operator()(unsigned int i) const;
 
 
   //----------------------------------------------
   // Assignment and set
 
-  inline SmVector2 &set(double d);
-  inline SmVector2 &set(double d0, double d1);
+  inline SmVector2 &set(SmReal d);
+  inline SmVector2 &set(SmReal d0, SmReal d1);
 
   inline SmVector2 &set(const SmVector2 &da);
-  inline SmVector2 &set(const double    *da);  
-  // da should point to a double[3] that will be copied
+  inline SmVector2 &set(const SmReal    *da);  
+  // da should point to a SmReal[3] that will be copied
 
-  inline SmVector2 &operator=(double d);
+  inline SmVector2 &operator=(SmReal d);
   inline SmVector2 &operator=(const SmVector2 &da);
-  inline SmVector2 &operator=(const double    *da);  
+  inline SmVector2 &operator=(const SmReal    *da);  
   
   //----------------------------------------------
   // Comparison operators
@@ -303,17 +314,17 @@ public:
   inline int operator==(const SmVector2 &da) const;
   inline int operator!=(const SmVector2 &da) const;
 
-  inline int operator==(double d) const;
-  inline int operator!=(double d) const;
+  inline int operator==(SmReal d) const;
+  inline int operator!=(SmReal d) const;
 
 
   //----------------------------------------------
   // In place arithmetic
 
-  inline SmVector2 &operator+=(double d);
-  inline SmVector2 &operator-=(double d);
-  inline SmVector2 &operator*=(double d);
-  inline SmVector2 &operator/=(double d);
+  inline SmVector2 &operator+=(SmReal d);
+  inline SmVector2 &operator-=(SmReal d);
+  inline SmVector2 &operator*=(SmReal d);
+  inline SmVector2 &operator/=(SmReal d);
 
   inline SmVector2 &operator+=(const SmVector2 &da);
   inline SmVector2 &operator-=(const SmVector2 &da);
@@ -341,7 +352,7 @@ public:
   //----------------------------------------------
   // Public data members
 
-  double data[2];
+  SmReal data[2];
 
   //----------------------------------------------
 };
@@ -358,15 +369,15 @@ inline SmVector2 operator-(const SmVector2 &a, const SmVector2 &b);
 inline SmVector2 operator*(const SmVector2 &a, const SmVector2 &b);
 inline SmVector2 operator/(const SmVector2 &a, const SmVector2 &b);
 
-inline SmVector2 operator+(const SmVector2 &a, double b);
-inline SmVector2 operator-(const SmVector2 &a, double b);
-inline SmVector2 operator*(const SmVector2 &a, double b);
-inline SmVector2 operator/(const SmVector2 &a, double b);
+inline SmVector2 operator+(const SmVector2 &a, SmReal b);
+inline SmVector2 operator-(const SmVector2 &a, SmReal b);
+inline SmVector2 operator*(const SmVector2 &a, SmReal b);
+inline SmVector2 operator/(const SmVector2 &a, SmReal b);
 
-inline SmVector2 operator+(double a, const SmVector2 &b);
-inline SmVector2 operator-(double a, const SmVector2 &b);
-inline SmVector2 operator*(double a, const SmVector2 &b);
-inline SmVector2 operator/(double a, const SmVector2 &b);
+inline SmVector2 operator+(SmReal a, const SmVector2 &b);
+inline SmVector2 operator-(SmReal a, const SmVector2 &b);
+inline SmVector2 operator*(SmReal a, const SmVector2 &b);
+inline SmVector2 operator/(SmReal a, const SmVector2 &b);
 
 std::istream &operator>>(std::istream &strm,      SmVector2 &v);
 std::ostream &operator<<(std::ostream &strm,const SmVector2 &v);
@@ -374,13 +385,13 @@ std::ostream &operator<<(std::ostream &strm,const SmVector2 &v);
 //-------------------------------------------------------------------
 // Norm type functions for SmVector2
 
-inline double   l1Norm(const SmVector2 &a);
-inline double   l2Norm(const SmVector2 &a);
-inline double lInfNorm(const SmVector2 &a);
+inline SmReal   l1Norm(const SmVector2 &a);
+inline SmReal   l2Norm(const SmVector2 &a);
+inline SmReal lInfNorm(const SmVector2 &a);
 // Computes the l1, l2 or lInfinity norm of a
 
-inline double    mag(const SmVector2 &a);
-inline double sqrMag(const SmVector2 &a);
+inline SmReal    mag(const SmVector2 &a);
+inline SmReal sqrMag(const SmVector2 &a);
 // mag is the l2Norm or magnitude of the vector
 // sqrMag is mag^2, which is faster to compute
 
@@ -399,18 +410,18 @@ inline unsigned int subinantAxis(const SmVector2 &v);
 // If multiple comonents have the same value, then the
 // results are not unique.
 
-inline double   dot(const SmVector2 &a,const SmVector2 &b);
-inline double cross(const SmVector2 &a,const SmVector2 &b);
+inline SmReal   dot(const SmVector2 &a,const SmVector2 &b);
+inline SmReal cross(const SmVector2 &a,const SmVector2 &b);
 // Compute the dot and cros product of a and b.
 
 inline SmVector2 abs(const SmVector2 &a);
 // returns a vector with r[i] = abs(a[i])
 
-inline double sum(const SmVector2 &a);
+inline SmReal sum(const SmVector2 &a);
 // return a[0]+a[1]
 
-inline double max(const SmVector2 &a);
-inline double min(const SmVector2 &a);
+inline SmReal max(const SmVector2 &a);
+inline SmReal min(const SmVector2 &a);
 // Returns the max or min component of a.
 
 inline SmVector2 max(const SmVector2 &a,const SmVector2 &b);
@@ -438,21 +449,21 @@ inline SmVector2 min(const SmVector2 &a,const SmVector2 &b);
 
 // Inline implementation of SmVector3
 
-inline double &SmVector3::operator[](unsigned int i) {
+inline SmReal &SmVector3::operator[](unsigned int i) {
   DB_CHECK(i<3);
   return data[i];
 }
-inline double &SmVector3::operator()(unsigned int i) {
+inline SmReal &SmVector3::operator()(unsigned int i) {
   DB_CHECK(i<3);
   return data[i];
 }
 
-inline double  SmVector3::operator[](unsigned int i) const {
+inline SmReal  SmVector3::operator[](unsigned int i) const {
   DB_CHECK(i<3);
   return data[i];
 }
   
-inline double  SmVector3::operator()(unsigned int i) const {
+inline SmReal  SmVector3::operator()(unsigned int i) const {
   DB_CHECK(i<3);
   return data[i];
 }
@@ -462,11 +473,11 @@ inline double  SmVector3::operator()(unsigned int i) const {
 inline SmVector3::SmVector3() {
   data[0] = data[1] = data[2] = 0.0;
 }
-inline SmVector3::SmVector3(double d) {
+inline SmVector3::SmVector3(SmReal d) {
   data[0] = data[1] = data[2] = d;
 }
 
-inline SmVector3::SmVector3(double d0,double d1,double d2) {
+inline SmVector3::SmVector3(SmReal d0,SmReal d1,SmReal d2) {
   data[0] = d0;
   data[1] = d1;
   data[2] = d2;
@@ -478,7 +489,7 @@ inline SmVector3::SmVector3(const SmVector3 &da) {
   data[2] = da[2];
 }
 
-inline SmVector3::SmVector3(const double *da) {
+inline SmVector3::SmVector3(const SmReal *da) {
   data[0] = da[0];
   data[1] = da[1];
   data[2] = da[2];
@@ -486,14 +497,14 @@ inline SmVector3::SmVector3(const double *da) {
   
 //-------------------------------------------------------------------
 
-inline SmVector3 &SmVector3::set(double d) {
+inline SmVector3 &SmVector3::set(SmReal d) {
   data[0] = d;
   data[1] = d;
   data[2] = d;
   return (*this);
 }
   
-inline SmVector3 &SmVector3::set(double d0, double d1, double d2) {
+inline SmVector3 &SmVector3::set(SmReal d0, SmReal d1, SmReal d2) {
   data[0] = d0;
   data[1] = d1;
   data[2] = d2;
@@ -507,7 +518,7 @@ inline SmVector3 &SmVector3::set(const SmVector3 &da) {
   return (*this);
 }
   
-inline SmVector3 &SmVector3::set(const double *da) {
+inline SmVector3 &SmVector3::set(const SmReal *da) {
   data[0] = da[0];
   data[1] = da[1];
   data[2] = da[2];
@@ -516,7 +527,7 @@ inline SmVector3 &SmVector3::set(const double *da) {
   
 //-------------------------------------------------------------------
 
-inline SmVector3 &SmVector3::operator=(double d) {
+inline SmVector3 &SmVector3::operator=(SmReal d) {
   return set(d);
 }
  
@@ -524,7 +535,7 @@ inline SmVector3 &SmVector3::operator=(const SmVector3 &da) {
   return set(da);
 }
 
-inline SmVector3 &SmVector3::operator=(const double *da) {
+inline SmVector3 &SmVector3::operator=(const SmReal *da) {
   return set(da);
 }
   
@@ -542,13 +553,13 @@ inline int SmVector3::operator!=(const SmVector3 &da) const {
 	  (data[2] != da[2]));
 }
   
-inline int SmVector3::operator==(double d) const {
+inline int SmVector3::operator==(SmReal d) const {
   return ((data[0] == d) &&
 	  (data[1] == d) &&
 	  (data[2] == d));
 }
 
-inline int SmVector3::operator!=(double d) const {
+inline int SmVector3::operator!=(SmReal d) const {
   return ((data[0] != d) ||
 	  (data[1] != d) ||
 	  (data[2] != d));
@@ -556,28 +567,28 @@ inline int SmVector3::operator!=(double d) const {
 
 //-------------------------------------------------------------------
 
-inline SmVector3 &SmVector3::operator+=(double d) {
+inline SmVector3 &SmVector3::operator+=(SmReal d) {
   data[0] += d;
   data[1] += d;
   data[2] += d;
   return (*this);
 }
     
-inline SmVector3 &SmVector3::operator-=(double d) {
+inline SmVector3 &SmVector3::operator-=(SmReal d) {
   data[0] -= d;
   data[1] -= d;
   data[2] -= d;
   return (*this);
 }
 
-inline SmVector3 &SmVector3::operator*=(double d) {
+inline SmVector3 &SmVector3::operator*=(SmReal d) {
   data[0] *= d;
   data[1] *= d;
   data[2] *= d;
   return (*this);
 }
 
-inline SmVector3 &SmVector3::operator/=(double d) {
+inline SmVector3 &SmVector3::operator/=(SmReal d) {
   data[0] /= d;
   data[1] /= d;
   data[2] /= d;
@@ -667,73 +678,73 @@ inline SmVector3 operator/(const SmVector3 &a,const SmVector3 &b){
 
 //-------------------------------------------------------------------
 
-inline SmVector3 operator+(const SmVector3 &a,double b){
+inline SmVector3 operator+(const SmVector3 &a,SmReal b){
   return SmVector3(a[0] + b, a[1] + b, a[2] + b);
 }
 
-inline SmVector3 operator-(const SmVector3 &a,double b){
+inline SmVector3 operator-(const SmVector3 &a,SmReal b){
   return SmVector3(a[0] - b, a[1] - b, a[2] - b);
 }
 
-inline SmVector3 operator*(const SmVector3 &a,double b){
+inline SmVector3 operator*(const SmVector3 &a,SmReal b){
   return SmVector3(a[0] * b, a[1] * b, a[2] * b);
 }
 
-inline SmVector3 operator/(const SmVector3 &a,double b){
+inline SmVector3 operator/(const SmVector3 &a,SmReal b){
   return SmVector3(a[0] / b, a[1] / b, a[2] / b);
 }
 
 //-------------------------------------------------------------------
 
-inline SmVector3 operator+(double a,const SmVector3 &b){
+inline SmVector3 operator+(SmReal a,const SmVector3 &b){
   return SmVector3(a + b[0], a + b[1], a + b[2]);
 }
 
-inline SmVector3 operator-(double a,const SmVector3 &b){
+inline SmVector3 operator-(SmReal a,const SmVector3 &b){
   return SmVector3(a - b[0], a - b[1], a - b[2]);
 }
 
-inline SmVector3 operator*(double a,const SmVector3 &b){
+inline SmVector3 operator*(SmReal a,const SmVector3 &b){
   return SmVector3(a * b[0], a * b[1], a * b[2]);
 }
 
-inline SmVector3 operator/(double a,const SmVector3 &b){
+inline SmVector3 operator/(SmReal a,const SmVector3 &b){
   return SmVector3(a / b[0], a / b[1], a / b[2]);
 }
 
 //-------------------------------------------------------------------
 
-inline double l1Norm(const SmVector3 &a) {
+inline SmReal l1Norm(const SmVector3 &a) {
   return (((a[0]>0)?a[0]:-a[0])+
 	  ((a[1]>0)?a[1]:-a[1])+
 	  ((a[2]>0)?a[2]:-a[2]));
 }
   
-inline double l2Norm(const SmVector3 &a) {
+inline SmReal l2Norm(const SmVector3 &a) {
   return sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
 }
   
-inline double lInfNorm(const SmVector3 &a) {
+inline SmReal lInfNorm(const SmVector3 &a) {
   return max(abs(a));
 }
 
-inline double mag(const SmVector3 &a) {
+inline SmReal mag(const SmVector3 &a) {
   return sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
 }
 
-inline double sqrMag(const SmVector3 &a) {
+inline SmReal sqrMag(const SmVector3 &a) {
   return (a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
 }
 
 inline void normalize(SmVector3 &a) {
-  register double m = mag(a);
+  register SmReal m = mag(a);
   if (m != 0) a /= m;
 }
 
 //-------------------------------------------------------------------
 
 inline unsigned int dominantAxis(const SmVector3 &v) {
-  register double x,y,z;
+  register SmReal x,y,z;
   if (v[0]>0) x = v[0]; else x = -v[0];
   if (v[1]>0) y = v[1]; else y = -v[1];
   if (v[2]>0) z = v[2]; else z = -v[2];
@@ -741,7 +752,7 @@ inline unsigned int dominantAxis(const SmVector3 &v) {
 }
 
 inline unsigned int subinantAxis(const SmVector3 &v) {
-  register double x,y,z;
+  register SmReal x,y,z;
   if (v[0]>0) x = v[0]; else x = -v[0];
   if (v[1]>0) y = v[1]; else y = -v[1];
   if (v[2]>0) z = v[2]; else z = -v[2];
@@ -749,7 +760,7 @@ inline unsigned int subinantAxis(const SmVector3 &v) {
 }
 
 inline unsigned int midinantAxis(const SmVector3 &v) {
-  register double x,y,z;
+  register SmReal x,y,z;
   if (v[0]>0) x = v[0]; else x = -v[0];
   if (v[1]>0) y = v[1]; else y = -v[1];
   if (v[2]>0) z = v[2]; else z = -v[2];
@@ -768,7 +779,7 @@ inline unsigned int midinantAxis(const SmVector3 &v) {
 
 //-------------------------------------------------------------------
 
-inline double dot(const SmVector3 &a,const SmVector3 &b) {
+inline SmReal dot(const SmVector3 &a,const SmVector3 &b) {
   return (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
 }
   
@@ -780,7 +791,7 @@ inline SmVector3 cross(const SmVector3 &a,const SmVector3 &b) {
 
 //-------------------------------------------------------------------
 
-inline double box(const SmVector3 &a,const SmVector3 &b,const SmVector3 &c) {
+inline SmReal box(const SmVector3 &a,const SmVector3 &b,const SmVector3 &c) {
   return dot(cross(a,b),c);
 }
 
@@ -792,17 +803,17 @@ inline SmVector3 abs(const SmVector3 &a) {
 		    ((a[2]>0)?a[2]:-a[2]));
 } 
 
-inline double sum(const SmVector3 &a) {
+inline SmReal sum(const SmVector3 &a) {
   return a[0]+a[1]+a[2];
 }
 
 //-------------------------------------------------------------------
 
-inline double max(const SmVector3 &a) {
+inline SmReal max(const SmVector3 &a) {
   return ((a[0]>a[1])?((a[0]>a[2])?a[0]:a[2]):(a[1]>a[2])?a[1]:a[2]);
 }	  
 
-inline double min(const SmVector3 &a) {
+inline SmReal min(const SmVector3 &a) {
   return ((a[0]<a[1])?((a[0]<a[2])?a[0]:a[2]):(a[1]<a[2])?a[1]:a[2]);
 }	  
 
@@ -826,21 +837,21 @@ inline SmVector3 min(const SmVector3 &a,const SmVector3 &b) {
 
 // Inline implementation of SmVector2
 
-inline double &SmVector2::operator[](unsigned int i) {
+inline SmReal &SmVector2::operator[](unsigned int i) {
   DB_CHECK(i<2);
   return data[i];
 }
-inline double &SmVector2::operator()(unsigned int i) {
+inline SmReal &SmVector2::operator()(unsigned int i) {
   DB_CHECK(i<2);
   return data[i];
 }
 
-inline double  SmVector2::operator[](unsigned int i) const {
+inline SmReal  SmVector2::operator[](unsigned int i) const {
   DB_CHECK(i<2);
   return data[i];
 }
   
-inline double  SmVector2::operator()(unsigned int i) const {
+inline SmReal  SmVector2::operator()(unsigned int i) const {
   DB_CHECK(i<2);
   return data[i];
 }
@@ -850,11 +861,11 @@ inline double  SmVector2::operator()(unsigned int i) const {
 inline SmVector2::SmVector2() {
   data[0] = data[1] = 0.0;
 }
-inline SmVector2::SmVector2(double d) {
+inline SmVector2::SmVector2(SmReal d) {
   data[0] = data[1] = d;
 }
 
-inline SmVector2::SmVector2(double d0,double d1) {
+inline SmVector2::SmVector2(SmReal d0,SmReal d1) {
   data[0] = d0;
   data[1] = d1;
 }
@@ -864,20 +875,20 @@ inline SmVector2::SmVector2(const SmVector2 &da) {
   data[1] = da[1];
 }
 
-inline SmVector2::SmVector2(const double *da) {
+inline SmVector2::SmVector2(const SmReal *da) {
   data[0] = da[0];
   data[1] = da[1];
 }
   
 //-------------------------------------------------------------------
 
-inline SmVector2 &SmVector2::set(double d) {
+inline SmVector2 &SmVector2::set(SmReal d) {
   data[0] = d;
   data[1] = d;
   return (*this);
 }
   
-inline SmVector2 &SmVector2::set(double d0, double d1) {
+inline SmVector2 &SmVector2::set(SmReal d0, SmReal d1) {
   data[0] = d0;
   data[1] = d1;
   return (*this);
@@ -889,7 +900,7 @@ inline SmVector2 &SmVector2::set(const SmVector2 &da) {
   return (*this);
 }
   
-inline SmVector2 &SmVector2::set(const double *da) {
+inline SmVector2 &SmVector2::set(const SmReal *da) {
   data[0] = da[0];
   data[1] = da[1];
   return (*this);
@@ -897,7 +908,7 @@ inline SmVector2 &SmVector2::set(const double *da) {
   
 //-------------------------------------------------------------------
 
-inline SmVector2 &SmVector2::operator=(double d) {
+inline SmVector2 &SmVector2::operator=(SmReal d) {
   return set(d);
 }
  
@@ -905,7 +916,7 @@ inline SmVector2 &SmVector2::operator=(const SmVector2 &da) {
   return set(da);
 }
 
-inline SmVector2 &SmVector2::operator=(const double *da) {
+inline SmVector2 &SmVector2::operator=(const SmReal *da) {
   return set(da);
 }
   
@@ -921,37 +932,37 @@ inline int SmVector2::operator!=(const SmVector2 &da) const {
 	  (data[1] != da[1]));
 }
   
-inline int SmVector2::operator==(double d) const {
+inline int SmVector2::operator==(SmReal d) const {
   return ((data[0] == d) &&
 	  (data[1] == d));
 }
 
-inline int SmVector2::operator!=(double d) const {
+inline int SmVector2::operator!=(SmReal d) const {
   return ((data[0] != d) ||
 	  (data[1] != d));
 }
 
 //-------------------------------------------------------------------
 
-inline SmVector2 &SmVector2::operator+=(double d) {
+inline SmVector2 &SmVector2::operator+=(SmReal d) {
   data[0] += d;
   data[1] += d;
   return (*this);
 }
     
-inline SmVector2 &SmVector2::operator-=(double d) {
+inline SmVector2 &SmVector2::operator-=(SmReal d) {
   data[0] -= d;
   data[1] -= d;
   return (*this);
 }
 
-inline SmVector2 &SmVector2::operator*=(double d) {
+inline SmVector2 &SmVector2::operator*=(SmReal d) {
   data[0] *= d;
   data[1] *= d;
   return (*this);
 }
 
-inline SmVector2 &SmVector2::operator/=(double d) {
+inline SmVector2 &SmVector2::operator/=(SmReal d) {
   data[0] /= d;
   data[1] /= d;
   return (*this);
@@ -1033,79 +1044,79 @@ inline SmVector2 operator/(const SmVector2 &a,const SmVector2 &b){
 
 //-------------------------------------------------------------------
 
-inline SmVector2 operator+(const SmVector2 &a,double b){
+inline SmVector2 operator+(const SmVector2 &a,SmReal b){
   return SmVector2(a[0] + b, a[1] + b);
 }
 
-inline SmVector2 operator-(const SmVector2 &a,double b){
+inline SmVector2 operator-(const SmVector2 &a,SmReal b){
   return SmVector2(a[0] - b, a[1] - b);
 }
 
-inline SmVector2 operator*(const SmVector2 &a,double b){
+inline SmVector2 operator*(const SmVector2 &a,SmReal b){
   return SmVector2(a[0] * b, a[1] * b);
 }
 
-inline SmVector2 operator/(const SmVector2 &a,double b){
+inline SmVector2 operator/(const SmVector2 &a,SmReal b){
   return SmVector2(a[0] / b, a[1] / b);
 }
 
 //-------------------------------------------------------------------
 
-inline SmVector2 operator+(double a,const SmVector2 &b){
+inline SmVector2 operator+(SmReal a,const SmVector2 &b){
   return SmVector2(a + b[0], a + b[1]);
 }
 
-inline SmVector2 operator-(double a,const SmVector2 &b){
+inline SmVector2 operator-(SmReal a,const SmVector2 &b){
   return SmVector2(a - b[0], a - b[1]);
 }
 
-inline SmVector2 operator*(double a,const SmVector2 &b){
+inline SmVector2 operator*(SmReal a,const SmVector2 &b){
   return SmVector2(a * b[0], a * b[1]);
 }
 
-inline SmVector2 operator/(double a,const SmVector2 &b){
+inline SmVector2 operator/(SmReal a,const SmVector2 &b){
   return SmVector2(a / b[0], a / b[1]);
 }
 
 //-------------------------------------------------------------------
 
-inline double l1Norm(const SmVector2 &a) {
+inline SmReal l1Norm(const SmVector2 &a) {
   return (((a[0]>0)?a[0]:-a[0])+
 	  ((a[1]>0)?a[1]:-a[1]));
 }
   
-inline double l2Norm(const SmVector2 &a) {
+inline SmReal l2Norm(const SmVector2 &a) {
   return sqrt(a[0] * a[0] + a[1] * a[1]);
 }
   
-inline double lInfNorm(const SmVector2 &a) {
+inline SmReal lInfNorm(const SmVector2 &a) {
   return max(abs(a));
 }
 
-inline double mag(const SmVector2 &a) {
+inline SmReal mag(const SmVector2 &a) {
   return sqrt(a[0] * a[0] + a[1] * a[1]);
 }
 
-inline double sqrMag(const SmVector2 &a) {
+inline SmReal sqrMag(const SmVector2 &a) {
   return (a[0] * a[0] + a[1] * a[1]);
 }
 
 inline void normalize(SmVector2 &a) {
-  register double m = mag(a);
+  register SmReal m = mag(a);
   if (m != 0) a /= m;
 }
 
 //-------------------------------------------------------------------
 
 inline unsigned int dominantAxis(const SmVector2 &v) {
-  register double x,y;
+  register SmReal x,y;
   if (v[0]>0) x = v[0]; else x = -v[0];
   if (v[1]>0) y = v[1]; else y = -v[1];
   return ( x > y ) ? 0 : 1;
 }
 
 inline unsigned int subinantAxis(const SmVector2 &v) {
-  register double x,y;
+  register SmReal x,y;
   if (v[0]>0) x = v[0]; else x = -v[0];
   if (v[1]>0) y = v[1]; else y = -v[1];
   return ( x < y ) ? 0 : 1;
@@ -1113,11 +1124,11 @@ inline unsigned int subinantAxis(const SmVector2 &v) {
 
 //-------------------------------------------------------------------
 
-inline double dot(const SmVector2 &a,const SmVector2 &b) {
+inline SmReal dot(const SmVector2 &a,const SmVector2 &b) {
   return (a[0] * b[0] + a[1] * b[1]);
 }
   
-inline double cross(const SmVector2 &a,const SmVector2 &b) {
+inline SmReal cross(const SmVector2 &a,const SmVector2 &b) {
   return (a[0] * b[1] - b[0] * a[1]);
 }
 
@@ -1128,17 +1139,17 @@ inline SmVector2 abs(const SmVector2 &a) {
 		    ((a[1]>0)?a[1]:-a[1]));
 } 
 
-inline double sum(const SmVector2 &a) {
+inline SmReal sum(const SmVector2 &a) {
   return a[0]+a[1];
 }
 
 //-------------------------------------------------------------------
 
-inline double max(const SmVector2 &a) {
+inline SmReal max(const SmVector2 &a) {
   return ((a[0]>a[1])? a[0] : a[1]);
 }	  
 
-inline double min(const SmVector2 &a) {
+inline SmReal min(const SmVector2 &a) {
   return ((a[0]<a[1])? a[0] : a[1]);
 }	  
 
@@ -0,0 +1,248 @@
+//-------------------------------------------------------------------
+//-------------------------------------------------------------------
+//
+// SmVector3P: a 3D vector padded to four lanes and held in SIMD
+// registers, with the same interface as SmVector3.  Used in the loops
+// that touch every triangle of the mesh; convert to SmVector3 to store.
+//
+// Backends, picked at compile time:
+//   AVX   four doubles in one __m256d
+//   SSE2  four doubles in two __m128d
+//   SSE   four floats in one __m128 (LSCULPT_FLOAT32)
+//   none  a plain array, for other targets
+//
+// The fourth lane is always zero, so sums over all lanes are the
+// three component sums, added in the same order as SmVector3 does.
+//
+//-------------------------------------------------------------------
+//-------------------------------------------------------------------
+
+#ifndef SM_VECTOR_SIMD_H
+#define SM_VECTOR_SIMD_H
+
+#include "smVector.h"
+
+#if defined(LSCULPT_FLOAT32)
+#  if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#    define SM_SIMD_SSE
+#    include <xmmintrin.h>
+#  endif
+#elif defined(__AVX__)
+#  define SM_SIMD_AVX
+#  include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define SM_SIMD_SSE2
+#  include <emmintrin.h>
+#endif
+
+//-------------------------------------------------------------------
+// Lane primitives for each backend
+
+#if defined(SM_SIMD_AVX)
+
+typedef __m256d SmLanes;
+
+inline SmLanes smLanesSet(SmReal x, SmReal y, SmReal z, SmReal w) { return _mm256_set_pd(w, z, y, x); }
+inline SmLanes smLanesAdd(SmLanes a, SmLanes b) { return _mm256_add_pd(a, b); }
+inline SmLanes smLanesSub(SmLanes a, SmLanes b) { return _mm256_sub_pd(a, b); }
+inline SmLanes smLanesMul(SmLanes a, SmLanes b) { return _mm256_mul_pd(a, b); }
+inline SmLanes smLanesDiv(SmLanes a, SmLanes b) { return _mm256_div_pd(a, b); }
+inline SmLanes smLanesMin(SmLanes a, SmLanes b) { return _mm256_min_pd(a, b); }
+inline SmLanes smLanesMax(SmLanes a, SmLanes b) { return _mm256_max_pd(a, b); }
+inline SmLanes smLanesAbs(SmLanes a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+inline SmLanes smLanesNeg(SmLanes a) { return _mm256_xor_pd(_mm256_set1_pd(-0.0), a); }
+// (x,y,z,w) -> (y,z,x,w), staying within AVX
+inline SmLanes smLanesYZX(SmLanes a) {
+  return _mm256_permute_pd(_mm256_shuffle_pd(a, _mm256_permute2f128_pd(a, a, 1), 5), 6);
+}
+inline void smLanesStore(SmLanes a, SmReal r[4]) { _mm256_storeu_pd(r, a); }
+
+#elif defined(SM_SIMD_SSE2)
+
+struct SmLanes { __m128d xy, zw; };
+
+inline SmLanes smLanesMake(__m128d xy, __m128d zw) { SmLanes r; r.xy = xy; r.zw = zw; return r; }
+inline SmLanes smLanesSet(SmReal x, SmReal y, SmReal z, SmReal w) { return smLanesMake(_mm_set_pd(y, x), _mm_set_pd(w, z)); }
+inline SmLanes smLanesAdd(SmLanes a, SmLanes b) { return smLanesMake(_mm_add_pd(a.xy, b.xy), _mm_add_pd(a.zw, b.zw)); }
+inline SmLanes smLanesSub(SmLanes a, SmLanes b) { return smLanesMake(_mm_sub_pd(a.xy, b.xy), _mm_sub_pd(a.zw, b.zw)); }
+inline SmLanes smLanesMul(SmLanes a, SmLanes b) { return smLanesMake(_mm_mul_pd(a.xy, b.xy), _mm_mul_pd(a.zw, b.zw)); }
+inline SmLanes smLanesDiv(SmLanes a, SmLanes b) { return smLanesMake(_mm_div_pd(a.xy, b.xy), _mm_div_pd(a.zw, b.zw)); }
+inline SmLanes smLanesMin(SmLanes a, SmLanes b) { return smLanesMake(_mm_min_pd(a.xy, b.xy), _mm_min_pd(a.zw, b.zw)); }
+inline SmLanes smLanesMax(SmLanes a, SmLanes b) { return smLanesMake(_mm_max_pd(a.xy, b.xy), _mm_max_pd(a.zw, b.zw)); }
+inline SmLanes smLanesAbs(SmLanes a) {
+  __m128d s = _mm_set1_pd(-0.0);
+  return smLanesMake(_mm_andnot_pd(s, a.xy), _mm_andnot_pd(s, a.zw));
+}
+inline SmLanes smLanesNeg(SmLanes a) {
+  __m128d s = _mm_set1_pd(-0.0);
+  return smLanesMake(_mm_xor_pd(s, a.xy), _mm_xor_pd(s, a.zw));
+}
+// (x,y,z,w) -> (y,z,x,w)
+inline SmLanes smLanesYZX(SmLanes a) { return smLanesMake(_mm_shuffle_pd(a.xy, a.zw, 1), _mm_shuffle_pd(a.xy, a.zw, 2)); }
+inline void smLanesStore(SmLanes a, SmReal r[4]) { _mm_storeu_pd(r, a.xy); _mm_storeu_pd(r + 2, a.zw); }
+
+#elif defined(SM_SIMD_SSE)
+
+typedef __m128 SmLanes;
+
+inline SmLanes smLanesSet(SmReal x, SmReal y, SmReal z, SmReal w) { return _mm_set_ps(w, z, y, x); }
+inline SmLanes smLanesAdd(SmLanes a, SmLanes b) { return _mm_add_ps(a, b); }
+inline SmLanes smLanesSub(SmLanes a, SmLanes b) { return _mm_sub_ps(a, b); }
+inline SmLanes smLanesMul(SmLanes a, SmLanes b) { return _mm_mul_ps(a, b); }
+inline SmLanes smLanesDiv(SmLanes a, SmLanes b) { return _mm_div_ps(a, b); }
+inline SmLanes smLanesMin(SmLanes a, SmLanes b) { return _mm_min_ps(a, b); }
+inline SmLanes smLanesMax(SmLanes a, SmLanes b) { return _mm_max_ps(a, b); }
+inline SmLanes smLanesAbs(SmLanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline SmLanes smLanesNeg(SmLanes a) { return _mm_xor_ps(_mm_set1_ps(-0.0f), a); }
+// (x,y,z,w) -> (y,z,x,w)
+inline SmLanes smLanesYZX(SmLanes a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)); }
+inline void smLanesStore(SmLanes a, SmReal r[4]) { _mm_storeu_ps(r, a); }
+
+#else
+
+struct SmLanes { SmReal l[4]; };
+
+inline SmLanes smLanesSet(SmReal x, SmReal y, SmReal z, SmReal w) { SmLanes r = {{x, y, z, w}}; return r; }
+inline SmLanes smLanesAdd(SmLanes a, SmLanes b) { for (int i = 0; i < 4; i++) a.l[i] += b.l[i]; return a; }
+inline SmLanes smLanesSub(SmLanes a, SmLanes b) { for (int i = 0; i < 4; i++) a.l[i] -= b.l[i]; return a; }
+inline SmLanes smLanesMul(SmLanes a, SmLanes b) { for (int i = 0; i < 4; i++) a.l[i] *= b.l[i]; return a; }
+inline SmLanes smLanesDiv(SmLanes a, SmLanes b) { for (int i = 0; i < 4; i++) a.l[i] /= b.l[i]; return a; }
+inline SmLanes smLanesMin(SmLanes a, SmLanes b) { for (int i = 0; i < 4; i++) if (!(a.l[i] < b.l[i])) a.l[i] = b.l[i]; return a; }
+inline SmLanes smLanesMax(SmLanes a, SmLanes b) { for (int i = 0; i < 4; i++) if (!(a.l[i] > b.l[i])) a.l[i] = b.l[i]; return a; }
+inline SmLanes smLanesAbs(SmLanes a) { for (int i = 0; i < 4; i++) a.l[i] = fabs(a.l[i]); return a; }
+inline SmLanes smLanesNeg(SmLanes a) { for (int i = 0; i < 4; i++) a.l[i] = -a.l[i]; return a; }
+inline SmLanes smLanesYZX(SmLanes a) { return smLanesSet(a.l[1], a.l[2], a.l[0], a.l[3]); }
+inline void smLanesStore(SmLanes a, SmReal r[4]) { for (int i = 0; i < 4; i++) r[i] = a.l[i]; }
+
+#endif
+
+//-------------------------------------------------------------------
+//-------------------------------------------------------------------
+
+class SmVector3P {
+  // Class to store a three dimensional vector in four SIMD lanes.
+  // Expected uses include point positions and surface normals.
+
+public:
+
+  //----------------------------------------------
+  // Constructors
+
+  inline SmVector3P() : v(smLanesSet(0, 0, 0, 0)) {};
+  inline SmVector3P(SmReal d) : v(smLanesSet(d, d, d, 0)) {};
+  inline SmVector3P(SmReal d0, SmReal d1, SmReal d2) : v(smLanesSet(d0, d1, d2, 0)) {};
+  inline SmVector3P(const SmVector3 &da) : v(smLanesSet(da[0], da[1], da[2], 0)) {};
+  inline SmVector3P(SmLanes l) : v(l) {};
+
+  //----------------------------------------------
+  // Conversion and index operators
+
+  inline operator SmVector3() const;
+  inline SmReal operator[](unsigned int i) const;
+
+  //----------------------------------------------
+  // Comparison operators
+
+  inline int operator==(const SmVector3P &da) const;
+  inline int operator!=(const SmVector3P &da) const { return !(*this == da); };
+
+  //----------------------------------------------
+  // In place arithmetic
+
+  inline SmVector3P &operator+=(SmReal d) { v = smLanesAdd(v, smLanesSet(d, d, d, 0)); return *this; };
+  inline SmVector3P &operator-=(SmReal d) { v = smLanesSub(v, smLanesSet(d, d, d, 0)); return *this; };
+  inline SmVector3P &operator*=(SmReal d) { v = smLanesMul(v, smLanesSet(d, d, d, 1)); return *this; };
+  inline SmVector3P &operator/=(SmReal d) { v = smLanesDiv(v, smLanesSet(d, d, d, 1)); return *this; };
+
+  inline SmVector3P &operator+=(const SmVector3P &da) { v = smLanesAdd(v, da.v); return *this; };
+  inline SmVector3P &operator-=(const SmVector3P &da) { v = smLanesSub(v, da.v); return *this; };
+  inline SmVector3P &operator*=(const SmVector3P &da) { v = smLanesMul(v, da.v); return *this; };
+  // Componentwise operations
+
+  inline SmVector3P &maxSet(const SmVector3P &da) { v = smLanesMax(da.v, v); return *this; };
+  inline SmVector3P &minSet(const SmVector3P &da) { v = smLanesMin(da.v, v); return *this; };
+  // Sets data[i] = max(data[i],da[i]) or min
+
+public:
+  //----------------------------------------------
+  // Public data members
+
+  SmLanes v;
+
+  //----------------------------------------------
+};
+
+//-------------------------------------------------------------------
+// Operators and functions for class SmVector3P
+
+inline SmVector3P operator-(const SmVector3P &a) { return smLanesNeg(a.v); }
+
+inline SmVector3P operator+(const SmVector3P &a, const SmVector3P &b) { return smLanesAdd(a.v, b.v); }
+inline SmVector3P operator-(const SmVector3P &a, const SmVector3P &b) { return smLanesSub(a.v, b.v); }
+inline SmVector3P operator*(const SmVector3P &a, const SmVector3P &b) { return smLanesMul(a.v, b.v); }
+
+inline SmVector3P operator+(const SmVector3P &a, SmReal b) { return smLanesAdd(a.v, smLanesSet(b, b, b, 0)); }
+inline SmVector3P operator-(const SmVector3P &a, SmReal b) { return smLanesSub(a.v, smLanesSet(b, b, b, 0)); }
+inline SmVector3P operator*(const SmVector3P &a, SmReal b) { return smLanesMul(a.v, smLanesSet(b, b, b, 1)); }
+inline SmVector3P operator/(const SmVector3P &a, SmReal b) { return smLanesDiv(a.v, smLanesSet(b, b, b, 1)); }
+inline SmVector3P operator*(SmReal a, const SmVector3P &b) { return b * a; }
+
+inline SmReal dot(const SmVector3P &a, const SmVector3P &b);
+inline SmVector3P cross(const SmVector3P &a, const SmVector3P &b);
+// Compute the dot and cross product of a and b.
+
+inline SmReal    mag(const SmVector3P &a) { return sqrt(dot(a, a)); }
+inline SmReal sqrMag(const SmVector3P &a) { return dot(a, a); }
+
+inline void normalize(SmVector3P &a) {
+  SmReal m = mag(a);
+  if (m != 0) a /= m;
+}
+
+inline SmVector3P abs(const SmVector3P &a) { return smLanesAbs(a.v); }
+// returns a vector with r[i] = abs(a[i])
+
+inline SmReal max(const SmVector3P &a);
+// Returns the max component of a.
+
+//-------------------------------------------------------------------
+//-------------------------------------------------------------------
+// Inline members for SmVector3P
+
+inline SmVector3P::operator SmVector3() const {
+  SmReal r[4];
+  smLanesStore(v, r);
+  return SmVector3(r[0], r[1], r[2]);
+}
+
+inline SmReal SmVector3P::operator[](unsigned int i) const {
+  SmReal r[4];
+  smLanesStore(v, r);
+  return r[i];
+}
+
+inline int SmVector3P::operator==(const SmVector3P &da) const {
+  SmReal a[4], b[4];
+  smLanesStore(v, a);
+  smLanesStore(da.v, b);
+  return (a[0] == b[0]) && (a[1] == b[1]) && (a[2] == b[2]);
+}
+
+inline SmReal dot(const SmVector3P &a, const SmVector3P &b) {
+  SmReal r[4];
+  smLanesStore(smLanesMul(a.v, b.v), r);
+  return (r[0] + r[1] + r[2]);
+}
+
+inline SmVector3P cross(const SmVector3P &a, const SmVector3P &b) {
+  // a * b.yzx - a.yzx * b is the cross product in zxy order
+  return smLanesYZX(smLanesSub(smLanesMul(a.v, smLanesYZX(b.v)), smLanesMul(smLanesYZX(a.v), b.v)));
+}
+
+inline SmReal max(const SmVector3P &a) {
+  SmReal r[4];
+  smLanesStore(a.v, r);
+  return ((r[0]>r[1])?((r[0]>r[2])?r[0]:r[2]):(r[1]>r[2])?r[1]:r[2]);
+}
+
+#endif // SM_VECTOR_SIMD_H